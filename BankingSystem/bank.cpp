@@ -4,6 +4,38 @@
 #include <vector>
 #include <exception>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <array>
+#include <cfloat>
+#include <unordered_set>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <cerrno>
+#include <coroutine>
 
 using namespace std;
 
@@ -13,10 +45,82 @@ using namespace std;
 #define ACCOUNT_SEP_LINE "---------------"
 #define BAD_FILE "Unable to open file"
 #define BAD_FORMAT "File is incorrectly formatted"
+#define BAD_JOURNAL "Unable to write the journal"
 #define NORMAL_EXIT 0
 #define BAD_ARGS 1
 #define CANNOT_OPEN_FILE 2
 #define BAD_FILE_FORMAT 3
+#define SHARD_REPORT_WIDTH 20
+#define HISTORY_SEGMENT_SIZE 4096
+#define HISTORY_RESIDENT_SEGMENTS 256
+#define HISTORY_SUFFIX ".history"
+#define HISTORY_INDEX "index"
+#define HISTORY_MAGIC "BANKHST1"
+#define STATEMENT_LENGTH 50
+#define NO_ENTRY -1
+#define TXN_DEPOSIT 'D'
+#define TXN_WITHDRAW 'W'
+#define CHECKPOINT_INTERVAL 1024
+#define MUTATION_SUFFIX ".mutations"
+#define MUTATION_INDEX "index"
+#define MUTATION_MAGIC "BANKMUT1"
+#define MUT_OPEN 'O'
+#define MUT_CLOSE 'X'
+#define MUT_MODIFY 'M'
+#define MUT_BALANCE 'B'
+#define TXN_INTEREST 'I'
+#define TXN_FEE 'F'
+#define ACCRUAL_CHUNK_SIZE 65536
+#define CSV_HEADER "number,holder,type,balance"
+#define IMPORT_BYTES_PER_RECORD 32
+#define LAZY_CACHE_SIZE 65536
+#define INDEX_MAGIC "BANKIDX2"
+#define INDEX_SUFFIX ".idx"
+#define SNAPSHOT_MAGIC "BANKSNP2"
+#define SNAPSHOT_EXTENSION ".snap"
+#define SNAPSHOT_BLOCK_SIZE 4096
+#define SNAPSHOT_BATCH_BLOCKS 64
+#define SNAPSHOT_CENTS_LIMIT 1e15
+#define DIFF_PARTITIONS 256
+#define BULK_CHUNK_SIZE 65536
+#define BULK_SUMMARY_ROWS 20
+#define SORT_MIN_CHUNK 4096
+#define SORT_BY_INSERTION 1
+#define SORT_BY_NUMBER 2
+#define SORT_BY_NAME 3
+#define SORT_BY_BALANCE 4
+#define CDC_RING_SIZE 65536
+#define CDC_BATCH_BYTES (1 << 16)
+#define CDC_ROTATE_BYTES (64LL << 20)
+#define CDC_ROTATE_KEEP 5
+#define CDC_SOCKET_PREFIX "unix:"
+#define TXID_GENERATION_SIZE (1 << 20)
+#define TXID_BLOOM_BITS (1 << 24)
+#define TXID_BLOOM_HASHES 4
+#define TXID_FILE_SUFFIX ".txids"
+#define TEMP_SUFFIX ".tmp"
+#define POSTINGS_HEADER "id,number,amount"
+#define FOLLOW_READ_SIZE (1 << 16)
+#define FOLLOW_POLL_MS 10
+#define SERVER_THREADS 4
+#define SERVER_BACKLOG 1024
+#define SERVER_READ_SIZE 4096
+#define SERVER_MAX_LINE 65536
+#define SERVER_EVENTS 256
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_HEADER "#savefile"
+#define SCRIPT_FLUSH_BYTES (1 << 16)
+#define HOT_STRIPES 64
+#define INDEX_MIN_CAPACITY 16
+#define LOOKUP_GROUP 16
+#define LOOKUP_NOT_FOUND -1
+#define BATCH_OK 0
+#define BATCH_NOT_FOUND 1
+#define BATCH_NEGATIVE_BALANCE 2
+#define BATCH_DUPLICATE 3
+#define BATCH_PREFETCH_DISTANCE 8
+#define POST_BATCH_SIZE 4096
+#define LAZY_BATCH_SIZE (LAZY_CACHE_SIZE / 4)
 
 /*
 Exception to handle when no account is able to be found.
@@ -48,1044 +152,8771 @@ struct AccountAlreadyExistsException : public std::exception {
 };
 
 /*
-Object to represent a single bank account. All account numbers
-must be unique. Balances cannot be 0 or below. Holder names are
-only allowed alphabetical letters and spaces.
+Function to return the current time.
+Params:
+    - void
+Returns:
+    - Microseconds since the epoch.
 */
-class Account {
-    private:
-        /*Private member variable for the account number.*/
-        int accNum;
-        /*Private member variable for the account holder.*/
-        string holder;
-        /*Private member variable for the account type.*/
-        string type;
-        /*Private member variable for the account balance.*/
-        float balance;
+long long current_time(void) {
+    return chrono::duration_cast<chrono::microseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*
+A single entry of an account's transaction history.
+*/
+struct Transaction {
+    /*Time of the transaction in microseconds since the epoch.*/
+    long long timestamp;
+    /*Account number the transaction was made on.*/
+    int accNum;
+    /*Kind of transaction (TXN_DEPOSIT or TXN_WITHDRAW).*/
+    char kind;
+    /*Amount deposited or withdrawn.*/
+    float amount;
+    /*Balance of the account after the transaction.*/
+    float balance;
+};
+
+/*
+A fixed size block of the transaction history, stored column by
+column. Each entry also stores the position of the previous entry
+for the same account, so an account's history can be followed
+backwards without looking at any other account's entries.
+*/
+class HistorySegment {
     public:
+        /*Column of transaction times.*/
+        vector<long long> timestamps;
+        /*Column of account numbers.*/
+        vector<int> accounts;
+        /*Column of transaction kinds.*/
+        vector<char> kinds;
+        /*Column of transaction amounts.*/
+        vector<float> amounts;
+        /*Column of resulting balances.*/
+        vector<float> balances;
+        /*Column of positions of the previous entry for the same account.*/
+        vector<long long> previous;
+
         /*
-        Instantiates a new account that stores the account number,
-        holder, type and balance.
+        Method to return the number of entries in the segment.
         Params:
-            - accNum: account number
-            - holder: name of the holder of the account
-            - type: the type this account is. (S or C).
-            - balance: the balance of the account.
+            - void
+        Returns:
+            - Number of entries.
         */
-        Account(int accNum, string holder, string type, float balance) {
-            this->accNum = accNum;
-            this->holder = holder;
-            this->type = type;
-            this->balance = balance;
+        int size(void) {
+            return timestamps.size();
         }
 
         /*
-        Method to return the account number.
+        Method to add an entry to the end of the segment.
         Params:
-            - void
+            - entry: the transaction to add
+            - previousEntry: position of the previous entry for the
+            same account, or NO_ENTRY.
         Returns:
-            - Account number
+            - void
         */
-        int get_acc_num(void) {
-            return accNum;
+        void append(Transaction entry, long long previousEntry) {
+            timestamps.push_back(entry.timestamp);
+            accounts.push_back(entry.accNum);
+            kinds.push_back(entry.kind);
+            amounts.push_back(entry.amount);
+            balances.push_back(entry.balance);
+            previous.push_back(previousEntry);
         }
 
         /*
-        Method to return the account holder
+        Method to return a single entry of the segment.
         Params:
-            - void
+            - index: position of the entry within the segment
         Returns:
-            - Account holder.
+            - The transaction stored at that position.
         */
-        string get_holder(void) {
-            return holder;
+        Transaction entry(int index) {
+            Transaction txn;
+            txn.timestamp = timestamps.at(index);
+            txn.accNum = accounts.at(index);
+            txn.kind = kinds.at(index);
+            txn.amount = amounts.at(index);
+            txn.balance = balances.at(index);
+            return txn;
         }
 
         /*
-        Method to return the account type
+        Method to write the segment's columns to a file.
         Params:
-            - void
+            - fileName: name of the file to write to
         Returns:
-            - Account type
+            - bool true if the segment was written, false otherwise.
         */
-        string get_type(void) {
-            return type;
+        bool write(string fileName) {
+            ofstream file(fileName, ios::binary);
+            int count = size();
+            file.write((char*) &count, sizeof(count));
+            file.write((char*) timestamps.data(), count * sizeof(long long));
+            file.write((char*) accounts.data(), count * sizeof(int));
+            file.write((char*) kinds.data(), count * sizeof(char));
+            file.write((char*) amounts.data(), count * sizeof(float));
+            file.write((char*) balances.data(), count * sizeof(float));
+            file.write((char*) previous.data(), count * sizeof(long long));
+            file.close();
+            return !file.fail();
         }
 
         /*
-        Method to return the account balance
+        Method to drop the entries after the first few.
         Params:
-            - void
+            - count: number of entries to keep
         Returns:
-            - Account balance
+            - void
         */
-        float get_balance(void) {
-            return balance;
+        void truncate(int count) {
+            timestamps.resize(count);
+            accounts.resize(count);
+            kinds.resize(count);
+            amounts.resize(count);
+            balances.resize(count);
+            previous.resize(count);
         }
 
         /*
-        Method to set the new account number for
-        this account object after the account has 
-        been modified.
+        Method to replace the segment's columns with those stored
+        in a file written by write.
         Params:
-            - num: new account number
+            - fileName: name of the file to read from
         Returns:
-            - void.
+            - bool true if the segment was read, false otherwise.
         */
-        void set_acc_number(int num) {
-            accNum = num;
+        bool read(string fileName) {
+            ifstream file(fileName, ios::binary);
+            int count = 0;
+            if (!file.read((char*) &count, sizeof(count)) || count < 0 || count > HISTORY_SEGMENT_SIZE) {
+                return false;
+            }
+            timestamps.resize(count);
+            accounts.resize(count);
+            kinds.resize(count);
+            amounts.resize(count);
+            balances.resize(count);
+            previous.resize(count);
+            file.read((char*) timestamps.data(), count * sizeof(long long));
+            file.read((char*) accounts.data(), count * sizeof(int));
+            file.read((char*) kinds.data(), count * sizeof(char));
+            file.read((char*) amounts.data(), count * sizeof(float));
+            file.read((char*) balances.data(), count * sizeof(float));
+            file.read((char*) previous.data(), count * sizeof(long long));
+            return (bool) file;
         }
+};
+
+/*
+Append-only transaction history for every account in a bank. Only
+the newest HISTORY_RESIDENT_SEGMENTS segments are kept in memory;
+older segments are spilled to disk and read back one at a time when
+a statement needs them, so memory use stays bounded however long
+the history grows. A new history spills to a temporary directory; a
+history saved next to a savefile (in the savefile's name followed by
+HISTORY_SUFFIX) is loaded with the bank and spills into that directory.
+*/
+class TransactionHistory {
+    private:
+        /*Private member variable to store the segments, null once spilled.*/
+        vector<unique_ptr<HistorySegment>> segments;
+        /*Private member variable for the oldest segment still in memory.*/
+        long long firstResident;
+        /*Private member variable for the most recent entry of each account.*/
+        unordered_map<int, long long> latest;
+        /*Private member variable for the prefix of spilled segment files.*/
+        string spillPrefix;
+        /*Private member variable for the spilled segment last read back.*/
+        HistorySegment cached;
+        /*Private member variable for the number of the cached segment.*/
+        long long cachedNumber;
+        /*Private member variable set while the spill directory is a temporary one.*/
+        bool temporary;
+        /*Private member variable for the directory the history was last saved to or loaded from.*/
+        string savedDirectory;
+        /*Private member variable for the number of entries in that directory.*/
+        long long savedEntries;
 
         /*
-        Method to set the new account holder for
-        this account object after the acconut has
-        been modified.
+        Method to write a segment held in memory to a file, replacing
+        the file only once the segment has been written in full.
         Params:
-            - name: new name of the acc. holder
+            - number: segment number
+            - fileName: name of the segment file
         Returns:
-            - void.
+            - bool true if the segment was written, false otherwise.
         */
-        void set_name(string name) {
-            holder = name;
+        bool write_segment(long long number, string fileName) {
+            if (!segments.at(number)->write(fileName + TEMP_SUFFIX)) {
+                return false;
+            }
+            error_code error;
+            filesystem::rename(fileName + TEMP_SUFFIX, fileName, error);
+            return !error;
         }
 
         /*
-        Method to set the new account holder for
-        this account object after the acconut has
-        been modified.
+        Method to build the name of the file a segment spills to.
         Params:
-            - name: new name of the acc. holder
+            - number: segment number
         Returns:
-            - void
+            - Name of the segment file.
         */
-        void set_acc_type(string newType) {
-            type = newType;
+        string segment_file(long long number) {
+            return spillPrefix + "." + to_string(number) + ".seg";
         }
 
         /*
-        Method to set the new account balance for
-        this account object after the acconut has
-        been modified.
+        Method to return the segment holding an entry, reading it
+        back from disk if it has been spilled.
         Params:
-            - newBalance: new account balance
+            - position: position of the entry in the history
         Returns:
-            - void
+            - Pointer to the segment holding the entry, or null if it
+            could not be read back.
         */
-        void set_balance(float newBalance) {
-            balance = newBalance;
+        HistorySegment* segment_for(long long position) {
+            long long number = position / HISTORY_SEGMENT_SIZE;
+            if (segments.at(number)) {
+                return segments.at(number).get();
+            }
+            if (cachedNumber != number) {
+                cachedNumber = NO_ENTRY;
+                if (!cached.read(segment_file(number)) || cached.size() != HISTORY_SEGMENT_SIZE) {
+                    return NULL;
+                }
+                cachedNumber = number;
+            }
+            return &cached;
         }
 
         /*
-        Method to increase the balance after depositing
-        money into the account.
+        Method to move the oldest segments held in memory to disk
+        until at most HISTORY_RESIDENT_SEGMENTS remain. A segment that
+        cannot be written is kept in memory, and spilling stops until
+        the next segment is started.
         Params:
-            - increase: amount deposited into the account
+            - void
         Returns:
             - void
         */
-        void increase_balance(float increase) {
-            balance = balance + increase;
+        void spill(void) {
+            while ((long long) segments.size() - firstResident > HISTORY_RESIDENT_SEGMENTS) {
+                if (firstResident == 0) {
+                    error_code error;
+                    filesystem::create_directories(
+                            filesystem::path(spillPrefix).parent_path(), error);
+                    if (error) {
+                        return;
+                    }
+                }
+                if (!write_segment(firstResident, segment_file(firstResident))) {
+                    return;
+                }
+                segments.at(firstResident).reset();
+                firstResident++;
+            }
         }
 
+    public:
         /*
-        Method to decrease the balance after withdrawing
-        money from the account. 
-        Params:
-            - decrease: amount withdrawn from the account
-        Returns:
-            - void.
-        Throws:
-            - NegativeBalanceException.
+        Instantiates a new empty history. Spilled segments are
+        written to a directory of their own in the temporary directory.
         */
-        void decrease_balance(float decrease) {
-            if (balance - decrease < 0) {
-                throw NegativeBalanceException();
-            } else {
-                balance = balance - decrease;
+        TransactionHistory(void) {
+            static atomic<int> instances(0);
+            filesystem::path directory = filesystem::temp_directory_path() /
+                    ("bank-history-" + to_string(getpid()) + "-" + to_string(instances++));
+            spillPrefix = (directory / "segment").string();
+            firstResident = 0;
+            cachedNumber = NO_ENTRY;
+            temporary = true;
+            savedEntries = 0;
+        }
+
+        /*
+        Removes any segments spilled to a temporary directory.
+        */
+        ~TransactionHistory(void) {
+            if (temporary && firstResident > 0) {
+                error_code ignored;
+                filesystem::remove_all(filesystem::path(spillPrefix).parent_path(), ignored);
             }
         }
 
         /*
-        Method to display the account information to the terminal.
+        Method to return the number of entries in the history.
         Params:
             - void
         Returns:
-            - void.
+            - Number of entries.
         */
-        void display_account(void) {
-            cout << "---Account Status---\n";
-            cout << "Account Number: " << to_string(accNum) << endl;
-            cout << "Account Holder Name: " << holder << endl;
-            cout << "Type of Account: " << type << endl;
-            cout << "Balance Amount: " << to_string(balance) << endl;
+        long long get_num_of_entries(void) {
+            if (segments.empty()) {
+                return 0;
+            }
+            return (segments.size() - 1) * (long long) HISTORY_SEGMENT_SIZE +
+                    segments.back()->size();
         }
 
         /*
-        Method to create a string of the account and it's information.
+        Method to add a transaction to the end of the history.
         Params:
-            - void
+            - accNum: account number the transaction was made on
+            - kind: kind of transaction
+            - amount: amount deposited or withdrawn
+            - balance: balance of the account after the transaction
         Returns:
-            - string representation of this account.
+            - void
         */
-        string account_string(void) {
-            string returnString = to_string(accNum) + '\n';
-            returnString = returnString + holder + '\n';
-            returnString = returnString + type + '\n';
-            returnString = returnString + to_string(balance) + '\n';
-            return returnString;
+        void record(int accNum, char kind, float amount, float balance) {
+            Transaction entry;
+            entry.timestamp = current_time();
+            entry.accNum = accNum;
+            entry.kind = kind;
+            entry.amount = amount;
+            entry.balance = balance;
+            append(entry);
         }
 
-};
-
-/*
-Class to represent a single bank object that holds multiple
-account objects.
-*/
-class Bank {
-    private:
-        /*Private member variable vector to store the bank accounts.*/
-        vector<Account> accounts;
-        /*Private member variable to track the number of accounts stored for this bank.*/
-        int numberOfAccounts;
-
-    public:
-        /*Public member variable to store the name of the bank.*/
-        string name;
-
         /*
-        Instantiates a new Bank Object with the specified name
+        Method to add a transaction, already timestamped, to the end
+        of the history.
         Params:
-            - name: name of the bank.
+            - entry: the transaction
+        Returns:
+            - void
         */
-        Bank(string name) {
-            this->name = name;
-            numberOfAccounts = 0;
+        void append(const Transaction& entry) {
+            if (segments.empty() || segments.back()->size() == HISTORY_SEGMENT_SIZE) {
+                segments.push_back(unique_ptr<HistorySegment>(new HistorySegment()));
+                segments.back()->timestamps.reserve(HISTORY_SEGMENT_SIZE);
+                spill();
+            }
+            long long position = get_num_of_entries();
+            unordered_map<int, long long>::iterator last = latest.find(entry.accNum);
+            if (last == latest.end()) {
+                segments.back()->append(entry, NO_ENTRY);
+                latest[entry.accNum] = position;
+            } else {
+                segments.back()->append(entry, last->second);
+                last->second = position;
+            }
         }
 
         /*
-        Method to add an account within the bank.
+        Method to add many transactions, already timestamped, to the
+        end of the history in order.
         Params:
-            - number: account number of new account
-            - holder: holder of the new account
-            - type: type of the new account
-            - amount: initial balance of the account
+            - entries: the transactions
         Returns:
             - void
         */
-        void add_account(int number, string holder, string type, float amount) {
-            for (int i = 0; i < numberOfAccounts; i++) {
-                if (accounts.at(i).get_acc_num() == number) {
-                    throw AccountAlreadyExistsException();
-                }
+        void append_all(const vector<Transaction>& entries) {
+            for (size_t i = 0; i < entries.size(); i++) {
+                append(entries[i]);
             }
-            Account* newAcc = new Account(number, holder, type, amount);
-            accounts.push_back(*newAcc);
-            numberOfAccounts++;
         }
 
         /*
-        Given an account number, this method finds that account stored
-        within the bank and returns a pointer to that object. If no
-        such account exists with such an account number in the bank, an
-        AccountNotFoundException is thrown.
+        Method to return the most recent transactions of an account.
         Params:
-            - number: Account number
+            - accNum: account number
+            - count: maximum number of transactions to return
         Returns:
-            - Pointer to the account object
-        Throws:
-            - AccountNotFoundException
+            - The transactions, newest first.
         */
-        Account* get_account(int number) {
-            for (int i = 0; i < accounts.size(); i++) {
-                if (number == accounts.at(i).get_acc_num()) {
-                    return &accounts.at(i);
+        vector<Transaction> recent(int accNum, int count) {
+            vector<Transaction> entries;
+            unordered_map<int, long long>::iterator last = latest.find(accNum);
+            long long position = last == latest.end() ? NO_ENTRY : last->second;
+            while (position != NO_ENTRY && (int) entries.size() < count) {
+                HistorySegment* segment = segment_for(position);
+                if (segment == NULL) {
+                    break;
                 }
+                int index = position % HISTORY_SEGMENT_SIZE;
+                entries.push_back(segment->entry(index));
+                position = segment->previous.at(index);
             }
-            throw AccountNotFoundException();
+            return entries;
         }
 
         /*
-        Method to display all accounts to the terminal.
+        Method to carry an account's history over to a new account
+        number.
         Params:
-            - void
+            - accNum: old account number
+            - newAccNum: new account number
         Returns:
             - void
         */
-        void display_accounts(void) {
-            for (int i = 0; i < accounts.size(); i++) {
-                accounts.at(i).display_account();;
+        void renumber(int accNum, int newAccNum) {
+            unordered_map<int, long long>::iterator last = latest.find(accNum);
+            if (last != latest.end()) {
+                latest[newAccNum] = last->second;
+                latest.erase(accNum);
             }
         }
 
         /*
-        Method to return the vector that stores the accounts
+        Method to forget an account's history, so an account later
+        opened with the same number starts with none.
         Params:
-            - void
+            - accNum: account number
         Returns:
-            - The vector that stores the accounts.
+            - void
         */
-        vector<Account> get_accounts(void) {
-            return accounts;
+        void forget(int accNum) {
+            latest.erase(accNum);
         }
 
         /*
-        Method to return the number of accounts within the bank
+        Method to save the history to a directory: every segment, then
+        an index of the number of entries and the most recent entry of
+        each account. Segments already saved to the directory and not
+        changed since are skipped, and the index is replaced only once
+        it has been written in full.
         Params:
-            - void
+            - directory: name of the directory
         Returns:
-            - Number of accounts within the bank.
+            - bool true if the history was saved, false otherwise.
         */
-        int get_num_of_accounts(void) {
-            return numberOfAccounts;
+        bool save(string directory) {
+            error_code error;
+            filesystem::create_directories(directory, error);
+            if (error) {
+                return false;
+            }
+            string prefix = (filesystem::path(directory) / "segment").string();
+            bool saved = directory.compare(savedDirectory) == 0;
+            for (long long i = 0; i < (long long) segments.size(); i++) {
+                string target = prefix + "." + to_string(i) + ".seg";
+                if (saved && (i + 1) * HISTORY_SEGMENT_SIZE <= savedEntries) {
+                    continue;
+                }
+                if (segments.at(i)) {
+                    if (!write_segment(i, target)) {
+                        return false;
+                    }
+                } else if (prefix.compare(spillPrefix) != 0) {
+                    filesystem::copy_file(segment_file(i), target,
+                            filesystem::copy_options::overwrite_existing, error);
+                    if (error) {
+                        return false;
+                    }
+                }
+            }
+            string indexName = (filesystem::path(directory) / HISTORY_INDEX).string();
+            ofstream index(indexName + TEMP_SUFFIX, ios::binary);
+            long long numberOfEntries = get_num_of_entries();
+            long long numberOfAccounts = latest.size();
+            index.write(HISTORY_MAGIC, strlen(HISTORY_MAGIC));
+            index.write((char*) &numberOfEntries, sizeof(numberOfEntries));
+            index.write((char*) &numberOfAccounts, sizeof(numberOfAccounts));
+            for (pair<const int, long long>& last : latest) {
+                index.write((char*) &last.first, sizeof(last.first));
+                index.write((char*) &last.second, sizeof(last.second));
+            }
+            index.close();
+            if (!index) {
+                return false;
+            }
+            filesystem::rename(indexName + TEMP_SUFFIX, indexName, error);
+            if (error) {
+                return false;
+            }
+            savedDirectory = directory;
+            savedEntries = numberOfEntries;
+            return true;
         }
 
         /*
-        Method to delete an account within the bank. If no such
-        account can be matched the requested account number than
-        an AccountNotFoundException will be thrown.
+        Method to load a history saved by save, which then spills into
+        the same directory. Must be called before anything is recorded.
+        A missing or damaged history leaves this one empty.
         Params:
-            - accNum: number of the account to be deleted.
-        
+            - directory: name of the directory
+        Returns:
+            - bool true if a history was loaded, false otherwise.
         */
-        void delete_account(int accNum) {
-            bool found = false;
-            for (int i = 0; i < numberOfAccounts; i++) {
-                if (accNum == accounts.at(i).get_acc_num()) {
-                    accounts.erase(accounts.begin() + i);
-                    found = true;
-                    break;
+        bool load(string directory) {
+            ifstream index((filesystem::path(directory) / HISTORY_INDEX).string(), ios::binary);
+            char magic[sizeof(HISTORY_MAGIC) - 1];
+            long long numberOfEntries, numberOfAccounts;
+            if (!index.read(magic, sizeof(magic)) || memcmp(magic, HISTORY_MAGIC, sizeof(magic)) != 0 ||
+                    !index.read((char*) &numberOfEntries, sizeof(numberOfEntries)) ||
+                    !index.read((char*) &numberOfAccounts, sizeof(numberOfAccounts)) ||
+                    numberOfEntries <= 0 || numberOfAccounts < 0) {
+                return false;
+            }
+            unordered_map<int, long long> loaded;
+            loaded.reserve(numberOfAccounts);
+            for (long long i = 0; i < numberOfAccounts; i++) {
+                int accNum;
+                long long position;
+                if (!index.read((char*) &accNum, sizeof(accNum)) ||
+                        !index.read((char*) &position, sizeof(position)) ||
+                        position < 0 || position >= numberOfEntries) {
+                    return false;
                 }
+                loaded[accNum] = position;
             }
-            if (found) {
-                numberOfAccounts--;
-            } else {
-                throw AccountNotFoundException();
+            string prefix = (filesystem::path(directory) / "segment").string();
+            long long numberOfSegments = (numberOfEntries + HISTORY_SEGMENT_SIZE - 1) / HISTORY_SEGMENT_SIZE;
+            int lastSize = numberOfEntries - (numberOfSegments - 1) * HISTORY_SEGMENT_SIZE;
+            unique_ptr<HistorySegment> last(new HistorySegment());
+            if (!last->read(prefix + "." + to_string(numberOfSegments - 1) + ".seg") ||
+                    last->size() < lastSize) {
+                return false;
             }
+            last->truncate(lastSize);
+            segments.clear();
+            segments.resize(numberOfSegments);
+            segments.back() = move(last);
+            firstResident = numberOfSegments - 1;
+            latest.swap(loaded);
+            spillPrefix = prefix;
+            cachedNumber = NO_ENTRY;
+            temporary = false;
+            savedDirectory = directory;
+            savedEntries = numberOfEntries;
+            return true;
         }
 };
 
 /*
-Function to check that the number of arguments
-put into the command line are correcnt. Function
-will exit the program if the number of args are 
-incorrect.
+Function to split the range [0, size) into chunks and run a task
+on every chunk, using one thread per core. Chunks are handed out as
+threads become free so uneven chunks do not hold up the others.
 Params:
-    - argc: number of arguments on the command line
+    - size: number of items to process
+    - chunkSize: number of items per chunk
+    - task: function taking the start and end of a chunk
 Returns:
     - void
 */
-void check_args(int argc) {
-    if (argc != 1 && argc != 2) {
-        cerr << "Incorrect number of arguments\n"
-             << "Usage: ./bank savefile or ./bank\n";
-        exit(BAD_ARGS);
+void parallel_for_chunks(size_t size, size_t chunkSize, function<void(size_t, size_t)> task) {
+    size_t numberOfChunks = (size + chunkSize - 1) / chunkSize;
+    size_t numberOfThreads = min((size_t) max(1u, thread::hardware_concurrency()), numberOfChunks);
+    atomic<size_t> nextChunk(0);
+    vector<exception_ptr> failures(numberOfThreads);
+    function<void(size_t)> worker = [&](size_t index) {
+        try {
+            for (size_t chunk = nextChunk++; chunk < numberOfChunks; chunk = nextChunk++) {
+                task(chunk * chunkSize, min(size, (chunk + 1) * chunkSize));
+            }
+        } catch (...) {
+            failures.at(index) = current_exception();
+            nextChunk = numberOfChunks;
+        }
+    };
+    vector<thread> threads;
+    for (size_t i = 1; i < numberOfThreads; i++) {
+        threads.push_back(thread(worker, i));
+    }
+    if (numberOfThreads > 0) {
+        worker(0);
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads.at(i).join();
+    }
+    for (size_t i = 0; i < failures.size(); i++) {
+        if (failures.at(i)) {
+            rethrow_exception(failures.at(i));
+        }
     }
 }
 
 /*
-Function to convert a string representation of a number
-to type int.
+Function to work out the chunk size used to split a sort over one
+thread per core.
 Params:
-    - numStr: string representation of a number
+    - size: number of items to sort
 Returns:
-    - The number of type int. If the number is invalid,
-    this function will return -1, else if the number is 
-    less then 0, it will return -2.
+    - The number of items per chunk.
 */
-int convert_string_to_int(string numStr) {
-    int number;
-    try {
-        number = stoi(numStr);
-    } catch (invalid_argument ia) {
-        return -1;
-    }
-    if (number < 0) {
-        return -2;
-    }
-    return number;
+size_t sort_chunk_size(size_t size) {
+    size_t numberOfThreads = max(1u, thread::hardware_concurrency());
+    return max((size_t) SORT_MIN_CHUNK, (size + numberOfThreads - 1) / numberOfThreads);
 }
 
 /*
-Function to convert a string representation of a number
-to type float.
+Sorts items by their upper 32 bits with a parallel radix sort, one
+byte per pass. Each thread counts the digits of its own chunk, the
+counts are turned into starting positions for every (digit, chunk)
+pair, and the threads then scatter their chunks. The sort is stable,
+so items whose keys are equal keep the order of their lower 32 bits
+when those were filled in ascending order.
 Params:
-    - numStr: string representation of a number
+    - items: items to sort, each a 32 bit key followed by 32 bits of data
 Returns:
-    - The number of type float. If the number is invalid,
-    this function will return -1, else if the number is 
-    less then 0, it will return -2.
+    - void
 */
-float convert_string_to_float(string numStr) {
-    float number;
-    try {
-        number = stof(numStr);
-    } catch (invalid_argument ia) {
-        return -1;
-    }
-    if (number < 0) {
-        return -2;
+void parallel_radix_sort(vector<unsigned long long>& items) {
+    size_t size = items.size();
+    size_t chunkSize = sort_chunk_size(size);
+    size_t numberOfChunks = (size + chunkSize - 1) / chunkSize;
+    vector<unsigned long long> buffer(size);
+    for (int shift = 32; shift < 64; shift += 8) {
+        vector<array<size_t, 256>> counts(numberOfChunks);
+        parallel_for_chunks(size, chunkSize, [&](size_t begin, size_t end) {
+            array<size_t, 256>& count = counts[begin / chunkSize];
+            count.fill(0);
+            for (size_t i = begin; i < end; i++) {
+                count[(items[i] >> shift) & 0xff]++;
+            }
+        });
+        size_t total = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            for (size_t c = 0; c < numberOfChunks; c++) {
+                size_t count = counts[c][digit];
+                counts[c][digit] = total;
+                total += count;
+            }
+        }
+        parallel_for_chunks(size, chunkSize, [&](size_t begin, size_t end) {
+            array<size_t, 256>& position = counts[begin / chunkSize];
+            for (size_t i = begin; i < end; i++) {
+                buffer[position[(items[i] >> shift) & 0xff]++] = items[i];
+            }
+        });
+        items.swap(buffer);
     }
-    return number;
 }
 
 /*
-This function gets user input from the terminal
-and returns a string of that input.
+Sorts items with a parallel merge sort: chunks are sorted on one
+thread per core, then neighbouring runs are merged in parallel,
+doubling in length each round. The sort is stable.
 Params:
-    - void
+    - items: items to sort
+    - less: comparison function
 Returns:
-    - A string of the user input.
+    - void
 */
-string get_user_input(void) {
-    string userInput;
-    getline(cin, userInput);
-    return userInput;
+template <typename T, typename Compare>
+void parallel_merge_sort(vector<T>& items, Compare less) {
+    size_t size = items.size();
+    size_t chunkSize = sort_chunk_size(size);
+    parallel_for_chunks(size, chunkSize, [&](size_t begin, size_t end) {
+        stable_sort(items.begin() + begin, items.begin() + end, less);
+    });
+    vector<T> buffer(size);
+    for (size_t width = chunkSize; width < size; width *= 2) {
+        parallel_for_chunks(size, 2 * width, [&](size_t begin, size_t end) {
+            size_t middle = min(begin + width, end);
+            merge(items.begin() + begin, items.begin() + middle, items.begin() + middle,
+                    items.begin() + end, buffer.begin() + begin, less);
+        });
+        items.swap(buffer);
+    }
 }
 
 /*
-Reads a single line from a file. If that file is badly
-formatted or cannot be read, this function will close
-the program.
+Function to map a float onto an unsigned number that sorts in the
+same order as the float.
 Params:
-    - file: pointer to the opened file to read from
+    - value: the float
 Returns:
-    - A string of the line read.
+    - The sortable key.
 */
-string getLine(ifstream* file) {
-    string line;
-    if (!getline(*file, line)) {
-        cerr << BAD_FORMAT << endl;
-        exit(BAD_FILE_FORMAT);
-    }
-    return line;
+unsigned int float_sort_key(float value) {
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
 }
 
 /*
-Checks to see if the given string is valid to be 
-used as a holder's name
+A single tier of the end of day run. The tier applies to accounts
+whose balance is at least minimumBalance, unless a higher tier also
+applies.
+*/
+struct AccrualTier {
+    /*Smallest balance this tier applies to.*/
+    float minimumBalance;
+    /*Interest rate for savings accounts, or flat fee for current accounts.*/
+    float rate;
+};
+
+/*
+Rates and fees applied by the end of day run. Tiers are sorted by
+minimum balance.
+*/
+struct AccrualConfig {
+    /*Interest rate tiers for savings (S) accounts.*/
+    vector<AccrualTier> savingsTiers;
+    /*Fee tiers for current (C) accounts.*/
+    vector<AccrualTier> currentTiers;
+};
+
+/*
+Totals of the postings made by an end of day run.
+*/
+struct AccrualSummary {
+    /*Number of interest postings made.*/
+    int interestPostings;
+    /*Number of fee postings made.*/
+    int feePostings;
+    /*Number of fees not charged because the balance was too low.*/
+    int feesSkipped;
+    /*Total interest paid.*/
+    double interestTotal;
+    /*Total fees charged.*/
+    double feeTotal;
+};
+
+/*
+Function to return the rates and fees used when no rates file is given.
 Params:
-    - input: string to be checked
+    - void
 Returns:
-    - bool true if the string is invalid
-    - bool false if the string is valid.
+    - The default end of day configuration.
 */
-bool invalid_string(string input) {
-    for (int i = 0; i < input.length(); i++) {
-        if ((input[i] < 'A' || input[i] > 'Z')  && 
-            (input[i] < 'a' || input[i] > 'z') && input[i] != ' ') {
-                return true;
-            }
-    }
-    return false;
+AccrualConfig default_accrual_config(void) {
+    AccrualConfig config;
+    config.savingsTiers = {{0, 0.0001f}, {1000, 0.0002f}, {10000, 0.0003f}};
+    config.currentTiers = {{0, 0.5f}, {1000, 0}};
+    return config;
 }
 
 /*
-Loads a bank off a given filename. If there is an issue with
-the format of the file at any point. The function will cause
-the program to exit.
+Loads the end of day rates from a file. Each line of the file holds
+a type (S or C), a minimum balance and either the interest rate
+(for S) or the fee (for C) of that tier.
 Params:
-    - filename: name of the save file of the bank data
+    - fileName: name of the rates file
+    - config: set to the loaded configuration
 Returns:
-    - A pointer to a bank object that is created within this function
-    and has all the data from the savefile loaded onto it.
+    - bool true if the file was loaded, false if it could not be
+    opened or is incorrectly formatted.
 */
-Bank* load_bank(string fileName) {
-    ifstream loadFile;
-    loadFile.open(fileName);
-    if (!loadFile) {
-        cerr << BAD_FILE << endl;
-        exit(CANNOT_OPEN_FILE);
-    }
-    string line = getLine(&loadFile);
-    Bank* bank;
-    bank = new Bank(line);
-    line = getLine(&loadFile);
-    int numOfAcc = convert_string_to_int(line);
-    if (numOfAcc == -1 || numOfAcc == -2) {
-        cerr << BAD_FORMAT << endl;
-        exit(BAD_FILE_FORMAT);
+bool load_accrual_config(string fileName, AccrualConfig* config) {
+    ifstream ratesFile(fileName);
+    if (!ratesFile) {
+        return false;
     }
-    for (int i = 0; i < numOfAcc; i++) {
-        line = getLine(&loadFile);
-        if (line.compare(ACCOUNT_SEP_LINE) == 0) {
-            int accNum = convert_string_to_int(getLine(&loadFile));
-            if (accNum == -1 || accNum == -2 || accNum == 0) {
-                cerr << BAD_FORMAT << endl;
-                exit(BAD_FILE_FORMAT);
-            }
-            string holder = getLine(&loadFile);
-            if (invalid_string(holder)) {
-                cerr << BAD_FORMAT << endl;
-                exit(BAD_FILE_FORMAT);
-            }
-            string type = getLine(&loadFile);
-            if (type.compare("S") != 0 && type.compare("C") != 0) {
-                cerr << BAD_FORMAT << endl;
-                exit(BAD_FILE_FORMAT);
-            }
-            float balance = convert_string_to_float(getLine(&loadFile));
-            if (balance == -1 || balance == -2 || balance == 0) {
-                cerr << BAD_FILE << endl;
-                exit(BAD_FILE_FORMAT);
-            }
-            bank->add_account(accNum, holder, type, balance);
-        } else if (line.compare("END") == 0) {
-            cout << "i:" << i << endl;
-            if (i != numOfAcc - 1) {
-                cerr << BAD_FORMAT << endl;
-                exit(BAD_FILE_FORMAT);
-            }
+    config->savingsTiers.clear();
+    config->currentTiers.clear();
+    string type;
+    AccrualTier tier;
+    while (ratesFile >> type >> tier.minimumBalance >> tier.rate) {
+        if (tier.minimumBalance < 0 || tier.rate < 0) {
+            return false;
+        }
+        if (type.compare("S") == 0) {
+            config->savingsTiers.push_back(tier);
+        } else if (type.compare("C") == 0) {
+            config->currentTiers.push_back(tier);
+        } else {
+            return false;
         }
     }
-    loadFile.close();
-    return bank;
+    if (!ratesFile.eof()) {
+        return false;
+    }
+    function<bool(AccrualTier, AccrualTier)> byMinimum = [](AccrualTier a, AccrualTier b) {
+        return a.minimumBalance < b.minimumBalance;
+    };
+    sort(config->savingsTiers.begin(), config->savingsTiers.end(), byMinimum);
+    sort(config->currentTiers.begin(), config->currentTiers.end(), byMinimum);
+    return true;
 }
 
 /*
-Creates a bank object based on the whether the bank
-is initialised with a save file or no save file.
+Checks whether a run of characters is valid as a holder's name:
+only the letters A-Z and a-z and spaces are allowed. Uses a lookup
+table, built at compile time so threads can share it, with no early
+exit, so the loop has no branches and can be vectorised by the
+compiler.
 Params:
-    - argc: number of input arguments
-    - argv: for the arguments
+    - text: characters to be checked
+    - length: number of characters
 Returns:
-    - A pointer to a bank object created within this funciton.
+    - bool true if the characters are valid
+    - bool false if they are not.
 */
-Bank* create_bank(int argc, char** argv) {
-    string bankName;
-    Bank* bank;
-    if (argc == 1) {
-        cout << "Enter the name of the bank: ";
-        getline(cin, bankName);
-        bank = new Bank(bankName);
-        return bank;
-    } else {
-        bank = load_bank(argv[1]);
-        return bank;
+bool valid_holder(const char* text, size_t length) {
+    static constexpr array<unsigned char, 256> allowed = [] {
+        array<unsigned char, 256> table = {};
+        for (int c = 0; c < 256; c++) {
+            table[c] = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == ' ';
+        }
+        return table;
+    }();
+    unsigned char all = 1;
+    for (size_t i = 0; i < length; i++) {
+        all &= allowed[(unsigned char) text[i]];
     }
+    return all;
 }
 
+/*
+Policies that fix the rules a bank is built with. Each deployment
+picks one policy for every rule at compile time, so the code for a
+rule that is not used is never compiled into the hot paths.
+*/
 
 /*
-Functino to querry the user until they have put in the correct
-input for a number. The generic T is used for ints and floats.
-Params:
-    - message: message to display when querrying the user
-    - function pointer: represents a function that takes in a
-    string and returns a type T. Used for functions
-    convert_string_to_int and convert_string_to_float.
-Returns:
-    - Number type (float or int) of the input given by the user.
+Overdraft rule: a withdrawal may not take the balance below zero.
 */
-template <typename T>
-T run_question_sequence(string message, T (*foo)(string)) {
-    T num;
-    while (true) {
-        cout << message;
-        string userInputStr = get_user_input();
-        num = foo(userInputStr);
-        if (num == -1) {
-            cout << "Please enter a valid number.\n";
-            continue;
-        } else if (num == 0) {
-            cout << "Please enter a non-zero account number.\n";
-            continue;
-        } else if (num == -2) {
-            cout << "Please enter a non-negative account number.\n";
-            continue;
-        }
-        break;
+struct NoOverdraft {
+    template <class Balance>
+    static bool allows(Balance balance, Balance decrease) {
+        return balance - decrease >= 0;
     }
-    return num;
-}
+};
 
 /*
-Querries the user for the account number of the new account
-Params:
-    - Pointer to the bank object
-Returns:
-    - The int representation of the number given by the user
+Type rule: accounts are savings (S) or current (C).
 */
-int get_account_number(Bank* bank) {
-    int accNum = run_question_sequence("Enter the account number: ", 
-            convert_string_to_int);
-    return accNum;
+struct SavingsCurrentTypes {
+    static bool valid(const string& type) {
+        return type.compare("S") == 0 || type.compare("C") == 0;
+    }
+};
 
-}
+/*
+Name rule: holder names only contain the letters A-Z and a-z and spaces.
+*/
+struct LetterNames {
+    static bool valid(const char* text, size_t length) {
+        return valid_holder(text, length);
+    }
+};
 
 /*
-Querries the user for the holder of the new account
-Params:
-    - message: message to querry the user
-Returns:
-    - String of the account holder.
+Locking strategy for a bank only used by one thread: no locking.
 */
-string get_account_holder(string message) {
-    string accHolder;
-    while (true) {
-        cout << message;
-        accHolder = get_user_input();
-        if (invalid_string(accHolder)) {
-            cout << 
-            "Please enter a holder name containing the characters between A-Z and a-z\n";
-            continue;
+struct NoLock {
+    struct Guard {
+        Guard(NoLock&) {
         }
-        break;
-    }
-    return accHolder;
-}
+    };
+};
 
 /*
-Querries the user for the type of the new account
-Params:
-    - message: message to display to the user when
-    querrying them.
-Returns:
-    - String of the type of the account.
+Locking strategy for a bank shared between threads: every operation
+holds the bank's mutex. The mutex is recursive because operations
+call each other (a deposit looks the account up).
 */
-string get_type_of_account(string message) {
-    string accType;
-    while (true) {
-        cout << message;
-        accType = get_user_input();
-        if (accType.compare("S") != 0 && accType.compare("C") != 0) {
-            cout << "Please enter S for savings or C for current account\n";
-            continue;
+struct MutexLock {
+    recursive_mutex mutex;
+    struct Guard {
+        lock_guard<recursive_mutex> held;
+        Guard(MutexLock& lock) : held(lock.mutex) {
         }
-        break;   
-    }
-    return accType;
-}
+    };
+};
 
 /*
-Querries the user for the balance of the new account
-Params:
-    - message: message to display to the user when
-    querrying them.
-Returns:
-    - Balance of the account in type float.
+Policy for the single threaded build.
 */
-float get_balance(string message) {
-    float amount = run_question_sequence(message, 
-            convert_string_to_float);
-    return amount;
-}
+struct BatchPolicy {
+    /*Representation of balances.*/
+    typedef float Balance;
+    /*Rule for withdrawals.*/
+    typedef NoOverdraft Overdraft;
+    /*Rule for account types.*/
+    typedef SavingsCurrentTypes Types;
+    /*Rule for holder names.*/
+    typedef LetterNames Names;
+    /*Locking strategy.*/
+    typedef NoLock Lock;
+};
 
 /*
-Function that forces the user to press enter to see
-the status of the action just completed before
-entering back to the main screen.
-Params:
-    - message: message to display to the user at
-    the end of an action (i.e. account withdrawal,
-    deposit, etc.)
-Returns:
-    - void
+Policy for the concurrent server build (compiled with BANK_CONCURRENT).
 */
-void end_action(string message) {
-    cout << message;
-    cout << "Press enter to continue.\n";
-    fgetc(stdin);
-    cout << string(31, '-') << endl;
-}
+struct ServerPolicy : public BatchPolicy {
+    /*Locking strategy.*/
+    typedef MutexLock Lock;
+};
+
+#ifdef BANK_CONCURRENT
+typedef ServerPolicy BankPolicy;
+#else
+typedef BatchPolicy BankPolicy;
+#endif
 
 /*
-Performs an account transaction for either a deposit
-or a withdrawl.
+Stripe of a hot account's pending deposits, alone on its cache line
+so that threads depositing into different stripes never contend.
+*/
+template <class Balance>
+struct alignas(64) HotStripe {
+    /*Sum of the deposits made into this stripe since the last fold.*/
+    atomic<Balance> delta;
+};
+
+/*
+Returns the stripe of hot account deposits used by the calling thread.
+Threads are given stripes in turn as they first deposit.
 Params:
-    - bank: pointer to the main bank object
-    - withdraw: flag to indicate whehter the account
-    transaction is a deposit or withdraw. True if
-    the transaction is a withdraw, false otherwise.
-Returns:
     - void
+Returns:
+    - Index of the stripe.
 */
-void account_transaction_form(Bank* bank, bool withdraw) {
-    cout << "----Account Transaction Form----\n";
-    int accNum = run_question_sequence("Enter the account number: ", 
-            convert_string_to_int);
-    bank->get_account(accNum)->display_account();
-    float amount;
-    if (!withdraw) {
-        amount = run_question_sequence("Enter the amount to deposit: ", 
-                convert_string_to_float);
-        bank->get_account(accNum)->increase_balance(amount);
-    } else {
-        while (true) {
-            amount = run_question_sequence("Enter the amount to withdraw: ", 
-                        convert_string_to_float);
-            try {
-                bank->get_account(accNum)->decrease_balance(amount);
-                break;
-            } catch (NegativeBalanceException &nb) {
-                cout << "Insufficient funds.\n";
-            }
-        }
-    }
+inline int hot_stripe(void) {
+    static atomic<unsigned int> nextStripe(0);
+    thread_local int stripe = nextStripe.fetch_add(1, memory_order_relaxed) % HOT_STRIPES;
+    return stripe;
 }
 
 /*
-Given a string (buffer) adds the account number to this string
+Balance of a hot account: an account, such as a merchant or
+settlement account, receiving so many deposits that they are not
+serialised on the account. Each thread adds its deposits to its own
+stripe without locking; the stripes are added to the balance when it
+is read, and folded into it before a withdrawal so the overdraft rule
+is checked against the exact balance. The holder and type are copied
+so deposits can be answered without the bank's lock. Folds are
+published through a version number, odd while a fold is moving
+deposits, so a reader never sees a deposit in neither place.
+*/
+template <class Balance>
+struct HotBalance {
+    /*Balance of the account, without the deposits still in the stripes.*/
+    atomic<Balance> base;
+    /*Deposits not yet folded into the balance.*/
+    HotStripe<Balance> stripes[HOT_STRIPES];
+    /*Whether deposits may still be made without the bank's lock.*/
+    atomic<bool> open;
+    /*Number of deposits being made without the bank's lock.*/
+    atomic<int> depositing;
+    /*Incremented before and after every fold.*/
+    atomic<unsigned int> version;
+    /*Account number.*/
+    int accNum;
+    /*Account holder.*/
+    string holder;
+    /*Account type.*/
+    string type;
+
+    HotBalance(int accNum, const string& holder, const string& type, Balance balance) :
+            base(balance), open(true), depositing(0), version(0), accNum(accNum), holder(holder), type(type) {
+        for (int i = 0; i < HOT_STRIPES; i++) {
+            stripes[i].delta.store(0, memory_order_relaxed);
+        }
+    }
+
+    /*
+    Method to deposit into the calling thread's stripe.
+    Params:
+        - amount: amount deposited
+    Returns:
+        - void
+    */
+    void add(Balance amount) {
+        stripes[hot_stripe()].delta.fetch_add(amount, memory_order_relaxed);
+    }
+
+    /*
+    Method to deposit without the bank's lock, unless deposits have
+    been closed.
+    Params:
+        - amount: amount deposited
+    Returns:
+        - bool true if the deposit was made, false if deposits are closed.
+    */
+    bool deposit(Balance amount) {
+        depositing.fetch_add(1);
+        if (!open.load()) {
+            depositing.fetch_sub(1);
+            return false;
+        }
+        add(amount);
+        depositing.fetch_sub(1);
+        return true;
+    }
+
+    /*
+    Method to stop deposits without the bank's lock, waiting for the
+    deposits already being made to finish.
+    Params:
+        - void
+    Returns:
+        - void
+    */
+    void close(void) {
+        open.store(false);
+        while (depositing.load() != 0) {
+            this_thread::yield();
+        }
+    }
+
+    /*
+    Method to return the balance including every pending deposit.
+    Params:
+        - void
+    Returns:
+        - The balance.
+    */
+    Balance total(void) {
+        while (true) {
+            unsigned int before = version.load();
+            if (before % 2 == 0) {
+                Balance sum = base.load();
+                for (int i = 0; i < HOT_STRIPES; i++) {
+                    sum += stripes[i].delta.load();
+                }
+                if (version.load() == before) {
+                    return sum;
+                }
+            }
+            this_thread::yield();
+        }
+    }
+
+    /*
+    Method to move every pending deposit into the balance. Only one
+    thread may fold, or set the balance, at a time.
+    Params:
+        - void
+    Returns:
+        - Sum of the deposits folded.
+    */
+    Balance fold(void) {
+        Balance merged = 0;
+        version.fetch_add(1);
+        for (int i = 0; i < HOT_STRIPES; i++) {
+            merged += stripes[i].delta.exchange(0);
+        }
+        base.store(base.load() + merged);
+        version.fetch_add(1);
+        return merged;
+    }
+};
+
+/*
+Object to represent a single bank account. All account numbers
+must be unique. Balances cannot be below 0. Holder names are
+only allowed alphabetical letters and spaces. The rules and the
+representation of the balance come from the Policy.
+*/
+template <class Policy>
+class BasicAccount {
+    public:
+        /*Representation of the account balance.*/
+        typedef typename Policy::Balance Balance;
+
+    private:
+        /*Private member variable for the account number.*/
+        int accNum;
+        /*Private member variable for the account holder.*/
+        string holder;
+        /*Private member variable for the account type.*/
+        string type;
+        /*Private member variable for the account balance.*/
+        Balance balance;
+        /*Private member variable for the balance of a hot account, or null.*/
+        HotBalance<Balance>* hot;
+    public:
+        /*
+        Instantiates a new account that stores the account number,
+        holder, type and balance.
+        Params:
+            - accNum: account number
+            - holder: name of the holder of the account
+            - type: the type this account is. (S or C).
+            - balance: the balance of the account.
+        */
+        BasicAccount(int accNum, string holder, string type, Balance balance) {
+            this->accNum = accNum;
+            this->holder = holder;
+            this->type = type;
+            this->balance = balance;
+            hot = NULL;
+        }
+
+        /*
+        Method to return the account number.
+        Params:
+            - void
+        Returns:
+            - Account number
+        */
+        int get_acc_num(void) {
+            return accNum;
+        }
+
+        /*
+        Method to return the account holder
+        Params:
+            - void
+        Returns:
+            - Account holder.
+        */
+        const string& get_holder(void) {
+            return holder;
+        }
+
+        /*
+        Method to return the account type
+        Params:
+            - void
+        Returns:
+            - Account type
+        */
+        const string& get_type(void) {
+            return type;
+        }
+
+        /*
+        Method to return the account balance
+        Params:
+            - void
+        Returns:
+            - Account balance
+        */
+        Balance get_balance(void) {
+            if (hot != NULL) {
+                return hot->total();
+            }
+            return balance;
+        }
+
+        /*
+        Method to return the balance of a hot account.
+        Params:
+            - void
+        Returns:
+            - Pointer to the hot balance, or null if the account is not hot.
+        */
+        HotBalance<Balance>* get_hot(void) {
+            return hot;
+        }
+
+        /*
+        Method to keep the balance of this account in a hot balance,
+        so that deposits are not serialised on the account.
+        Params:
+            - hotBalance: the hot balance, holding the account's balance
+        Returns:
+            - void
+        */
+        void make_hot(HotBalance<Balance>* hotBalance) {
+            hot = hotBalance;
+        }
+
+        /*
+        Method to stop deposits into the hot balance of this account
+        without the bank's lock, once those already being made finish.
+        Does nothing if the account is not hot.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void close_deposits(void) {
+            if (hot != NULL) {
+                hot->close();
+            }
+        }
+
+        /*
+        Method to keep the balance of this account in the account again.
+        Deposits can no longer be made into the hot balance.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void make_cold(void) {
+            if (hot != NULL) {
+                hot->close();
+                balance = hot->total();
+                hot = NULL;
+            }
+        }
+
+        /*
+        Method to fold the pending deposits of a hot account into its
+        balance. Does nothing if the account is not hot.
+        Params:
+            - void
+        Returns:
+            - Sum of the deposits folded.
+        */
+        Balance fold_deposits(void) {
+            return hot != NULL ? hot->fold() : 0;
+        }
+
+        /*
+        Method to set the new account number for
+        this account object after the account has 
+        been modified.
+        Params:
+            - num: new account number
+        Returns:
+            - void.
+        */
+        void set_acc_number(int num) {
+            accNum = num;
+        }
+
+        /*
+        Method to set the new account holder for
+        this account object after the acconut has
+        been modified.
+        Params:
+            - name: new name of the acc. holder
+        Returns:
+            - void.
+        */
+        void set_name(string name) {
+            holder = name;
+        }
+
+        /*
+        Method to set the new account holder for
+        this account object after the acconut has
+        been modified.
+        Params:
+            - name: new name of the acc. holder
+        Returns:
+            - void
+        */
+        void set_acc_type(string newType) {
+            type = newType;
+        }
+
+        /*
+        Method to set the new account balance for
+        this account object after the acconut has
+        been modified.
+        Params:
+            - newBalance: new account balance
+        Returns:
+            - void
+        */
+        void set_balance(Balance newBalance) {
+            if (hot != NULL) {
+                hot->fold();
+                hot->base.store(newBalance);
+                return;
+            }
+            balance = newBalance;
+        }
+
+        /*
+        Method to increase the balance after depositing
+        money into the account. The balance of a hot account is
+        changed directly; only Bank::deposit_hot adds to its stripes.
+        Params:
+            - increase: amount deposited into the account
+        Returns:
+            - void
+        */
+        void increase_balance(Balance increase) {
+            if (hot != NULL) {
+                hot->base.store(hot->base.load() + increase);
+                return;
+            }
+            balance = balance + increase;
+        }
+
+        /*
+        Method to decrease the balance after withdrawing
+        money from the account. The pending deposits of a hot account
+        must be folded first (see Bank::fold_hot); they are not counted.
+        Params:
+            - decrease: amount withdrawn from the account
+        Returns:
+            - void.
+        Throws:
+            - NegativeBalanceException.
+        */
+        void decrease_balance(Balance decrease) {
+            if (hot != NULL) {
+                Balance current = hot->base.load();
+                if (!Policy::Overdraft::allows(current, decrease)) {
+                    throw NegativeBalanceException();
+                }
+                hot->base.store(current - decrease);
+                return;
+            }
+            if (!Policy::Overdraft::allows(balance, decrease)) {
+                throw NegativeBalanceException();
+            } else {
+                balance = balance - decrease;
+            }
+        }
+
+        /*
+        Method to display the account information to the terminal.
+        Params:
+            - void
+        Returns:
+            - void.
+        */
+        void display_account(void) {
+            cout << "---Account Status---\n";
+            cout << "Account Number: " << to_string(accNum) << endl;
+            cout << "Account Holder Name: " << holder << endl;
+            cout << "Type of Account: " << type << endl;
+            cout << "Balance Amount: " << to_string(get_balance()) << endl;
+        }
+
+        /*
+        Method to create a string of the account and it's information.
+        Params:
+            - void
+        Returns:
+            - string representation of this account.
+        */
+        string account_string(void) {
+            string returnString = to_string(accNum) + '\n';
+            returnString = returnString + holder + '\n';
+            returnString = returnString + type + '\n';
+            returnString = returnString + to_string(get_balance()) + '\n';
+            return returnString;
+        }
+
+};
+
+typedef BasicAccount<BankPolicy> Account;
+
+/*
+A single change made to the accounts of a bank.
+*/
+struct Mutation {
+    /*Time of the change in microseconds since the epoch.*/
+    long long timestamp;
+    /*Kind of change (MUT_OPEN, MUT_CLOSE, MUT_MODIFY or MUT_BALANCE).*/
+    char kind;
+    /*Account number the change was made on.*/
+    int accNum;
+    /*Account number after the change (differs only for MUT_MODIFY).*/
+    int newAccNum;
+    /*Holder after the change.*/
+    string holder;
+    /*Type after the change.*/
+    string type;
+    /*Balance before the change (0 for MUT_OPEN).*/
+    Account::Balance previousBalance;
+    /*Balance after the change (0 for MUT_CLOSE).*/
+    Account::Balance balance;
+};
+
+/*
+A change as kept in the mutation log. The holder and type are kept
+as positions in the log's table of names, so a change does not copy
+them.
+*/
+struct LoggedMutation {
+    /*Time of the change in microseconds since the epoch.*/
+    long long timestamp;
+    /*Account number the change was made on.*/
+    int accNum;
+    /*Account number after the change (differs only for MUT_MODIFY).*/
+    int newAccNum;
+    /*Position of the holder after the change in the table of names.*/
+    int holder;
+    /*Position of the type after the change in the table of names.*/
+    int type;
+    /*Balance before the change (0 for MUT_OPEN).*/
+    Account::Balance previousBalance;
+    /*Balance after the change (0 for MUT_CLOSE).*/
+    Account::Balance balance;
+    /*Kind of change (MUT_OPEN, MUT_CLOSE, MUT_MODIFY or MUT_BALANCE).*/
+    char kind;
+};
+
+/*
+A point in the mutation log at which the balances of every account
+were written to a checkpoint file.
+*/
+struct Checkpoint {
+    /*Time of the last mutation covered by the checkpoint.*/
+    long long timestamp;
+    /*Number of mutations covered by the checkpoint.*/
+    long long position;
+    /*Sum of all balances.*/
+    double totalBalance;
+};
+
+/*
+Log of every change made to a bank's accounts, with a checkpoint of
+all balances taken every so often. A historical query starts from
+the nearest earlier checkpoint and only replays the mutations made
+after it. Checkpoints are taken every CHECKPOINT_INTERVAL mutations,
+or every number-of-accounts mutations for large banks so the cost
+of copying the balances stays constant per mutation. The balances
+of a checkpoint are written to a file of their own, and only the
+mutations made since the last checkpoint are kept in memory; older
+ones are read back from the log file. Like the transaction history,
+a new log is written to a temporary directory, and a log saved next
+to a savefile (in the savefile's name followed by MUTATION_SUFFIX)
+is loaded with the bank and written to from then on.
+*/
+class MutationLog {
+    private:
+        /*Private member variable to store the mutations made since the last checkpoint.*/
+        vector<LoggedMutation> recent;
+        /*Private member variable for the position of the first mutation in memory.*/
+        long long firstRecent;
+        /*Private member variable for the number of mutations in the log file.*/
+        long long written;
+        /*Private member variable to store the checkpoints, oldest first.*/
+        vector<Checkpoint> checkpoints;
+        /*Private member variable mapping every holder and type to its position.*/
+        unordered_map<string, int> names;
+        /*Private member variable for the names not yet in the names file, oldest first.*/
+        vector<const string*> unwrittenNames;
+        /*Private member variable for the size of the names file.*/
+        long long namesBytes;
+        /*Private member variable for the directory the log is written to.*/
+        string directory;
+        /*Private member variable set while that directory is a temporary one.*/
+        bool temporary;
+
+        /*
+        Method to build the name of a file in the log's directory.
+        Params:
+            - name: name of the file within the directory
+        Returns:
+            - Name of the file.
+        */
+        string file(string name) {
+            return (filesystem::path(directory) / name).string();
+        }
+
+        /*
+        Method to build the name of the file holding a checkpoint's balances.
+        Params:
+            - number: checkpoint number
+        Returns:
+            - Name of the checkpoint file.
+        */
+        string checkpoint_file(long long number) {
+            return file("checkpoint." + to_string(number));
+        }
+
+        /*
+        Method to return the position of a holder or type in the
+        table of names, adding it if it is not there yet.
+        Params:
+            - name: the holder or type
+        Returns:
+            - Position of the name.
+        */
+        int intern(const string& name) {
+            pair<unordered_map<string, int>::iterator, bool> found =
+                    names.insert(make_pair(name, (int) names.size()));
+            if (found.second) {
+                unwrittenNames.push_back(&found.first->first);
+            }
+            return found.first->second;
+        }
+
+        /*
+        Method to write data into a file at an offset, creating the
+        file if it does not exist.
+        Params:
+            - fileName: name of the file
+            - offset: offset to write at
+            - data: the data
+            - size: number of bytes to write
+        Returns:
+            - bool true if the data was written, false otherwise.
+        */
+        static bool write_at(string fileName, long long offset, const char* data, size_t size) {
+            fstream output(fileName, ios::in | ios::out | ios::binary);
+            if (!output) {
+                output.clear();
+                output.open(fileName, ios::out | ios::binary);
+            }
+            output.seekp(offset);
+            output.write(data, size);
+            output.close();
+            return !output.fail();
+        }
+
+        /*
+        Method to append the mutations and names not yet written to
+        the log and names files.
+        Params:
+            - void
+        Returns:
+            - bool true if they were written, false otherwise.
+        */
+        bool flush(void) {
+            error_code error;
+            filesystem::create_directories(directory, error);
+            if (error) {
+                return false;
+            }
+            long long total = get_num_of_mutations();
+            if (written < total && !write_at(file("log"), written * sizeof(LoggedMutation),
+                    (const char*) &recent[written - firstRecent],
+                    (total - written) * sizeof(LoggedMutation))) {
+                return false;
+            }
+            written = total;
+            string buffer;
+            for (size_t i = 0; i < unwrittenNames.size(); i++) {
+                int length = unwrittenNames[i]->size();
+                buffer.append((const char*) &length, sizeof(length));
+                buffer.append(*unwrittenNames[i]);
+            }
+            if (!buffer.empty() && !write_at(file("names"), namesBytes, buffer.data(), buffer.size())) {
+                return false;
+            }
+            namesBytes += buffer.size();
+            unwrittenNames.clear();
+            return true;
+        }
+
+        /*
+        Method to write the balances of every account to a new
+        checkpoint file, then move the mutations made since the last
+        checkpoint out of memory. If the checkpoint cannot be written
+        it is not taken, and if the mutations cannot be written they
+        are kept in memory.
+        Params:
+            - timestamp: time of the last mutation covered
+            - accounts: the bank's accounts
+        Returns:
+            - void
+        */
+        template <class A>
+        void take_checkpoint(long long timestamp, vector<A>& accounts) {
+            Checkpoint checkpoint;
+            checkpoint.timestamp = timestamp;
+            checkpoint.position = get_num_of_mutations();
+            checkpoint.totalBalance = 0;
+            vector<pair<int, Account::Balance>> balances;
+            balances.reserve(accounts.size());
+            for (size_t i = 0; i < accounts.size(); i++) {
+                balances.push_back(make_pair(accounts[i].get_acc_num(), accounts[i].get_balance()));
+                checkpoint.totalBalance += accounts[i].get_balance();
+            }
+            sort(balances.begin(), balances.end());
+            error_code error;
+            filesystem::create_directories(directory, error);
+            string fileName = checkpoint_file(checkpoints.size());
+            ofstream output(fileName + TEMP_SUFFIX, ios::binary);
+            output.write((const char*) balances.data(), balances.size() * sizeof(balances[0]));
+            output.close();
+            if (error || !output) {
+                return;
+            }
+            filesystem::rename(fileName + TEMP_SUFFIX, fileName, error);
+            if (error) {
+                return;
+            }
+            checkpoints.push_back(checkpoint);
+            if (flush()) {
+                recent.clear();
+                firstRecent = written;
+            }
+        }
+
+        /*
+        Method to find the balance an account had at a checkpoint,
+        searching the checkpoint file.
+        Params:
+            - number: checkpoint number
+            - accNum: account number
+            - balance: set to the balance of the account
+        Returns:
+            - bool true if the account existed at the checkpoint, false otherwise.
+        */
+        bool checkpoint_balance(long long number, int accNum, Account::Balance* balance) {
+            ifstream input(checkpoint_file(number), ios::binary);
+            error_code error;
+            long long size = filesystem::file_size(checkpoint_file(number), error);
+            if (!input || error) {
+                return false;
+            }
+            pair<int, Account::Balance> entry;
+            long long low = 0;
+            long long high = size / sizeof(entry);
+            while (low < high) {
+                long long middle = (low + high) / 2;
+                input.seekg(middle * sizeof(entry));
+                if (!input.read((char*) &entry, sizeof(entry))) {
+                    return false;
+                }
+                if (entry.first == accNum) {
+                    *balance = entry.second;
+                    return true;
+                }
+                if (entry.first < accNum) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+            return false;
+        }
+
+        /*
+        Method to find the latest checkpoint taken at or before a time.
+        Params:
+            - time: time in microseconds since the epoch
+        Returns:
+            - Number of the checkpoint, or -1 if there is none.
+        */
+        long long checkpoint_before(long long time) {
+            long long low = 0;
+            long long high = checkpoints.size();
+            while (low < high) {
+                long long middle = (low + high) / 2;
+                if (checkpoints.at(middle).timestamp <= time) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+            return low - 1;
+        }
+
+        /*
+        Method to visit the mutations made from a position in the log
+        up to a time, oldest first, reading them back from the log
+        file where they are no longer in memory.
+        Params:
+            - position: position of the first mutation
+            - time: time in microseconds since the epoch
+            - visit: function called with every mutation
+        Returns:
+            - void
+        */
+        void replay(long long position, long long time, function<void(LoggedMutation&)> visit) {
+            LoggedMutation mutation;
+            if (position < firstRecent) {
+                ifstream input(file("log"), ios::binary);
+                input.seekg(position * sizeof(mutation));
+                for (; position < firstRecent; position++) {
+                    if (!input.read((char*) &mutation, sizeof(mutation)) || mutation.timestamp > time) {
+                        return;
+                    }
+                    visit(mutation);
+                }
+            }
+            for (; position < get_num_of_mutations(); position++) {
+                if (recent[position - firstRecent].timestamp > time) {
+                    return;
+                }
+                visit(recent[position - firstRecent]);
+            }
+        }
+
+        /*
+        Method to sum up the account numbers and balances, to the
+        cent, of a bank's accounts, so a saved log can be checked
+        against the savefile it was saved with.
+        Params:
+            - accounts: the bank's accounts
+        Returns:
+            - The sum.
+        */
+        template <class A>
+        static unsigned long long digest(vector<A>& accounts) {
+            unsigned long long sum = 0;
+            for (size_t i = 0; i < accounts.size(); i++) {
+                unsigned long long value = ((unsigned long long) (unsigned int) accounts[i].get_acc_num() << 32) ^
+                        (unsigned long long) llround((double) accounts[i].get_balance() * 100);
+                sum += value * 0x9E3779B97F4A7C15ull ^ (value >> 29);
+            }
+            return sum;
+        }
+
+    public:
+        /*
+        Instantiates a new empty log, written to a directory of its
+        own in the temporary directory.
+        */
+        MutationLog(void) {
+            static atomic<int> instances(0);
+            directory = (filesystem::temp_directory_path() /
+                    ("bank-mutations-" + to_string(getpid()) + "-" + to_string(instances++))).string();
+            firstRecent = 0;
+            written = 0;
+            namesBytes = 0;
+            temporary = true;
+        }
+
+        /*
+        Removes the log written to a temporary directory.
+        */
+        ~MutationLog(void) {
+            if (temporary) {
+                error_code ignored;
+                filesystem::remove_all(directory, ignored);
+            }
+        }
+
+        /*
+        Method to return the number of mutations logged.
+        Params:
+            - void
+        Returns:
+            - Number of mutations.
+        */
+        long long get_num_of_mutations(void) {
+            return firstRecent + recent.size();
+        }
+
+        /*
+        Method to add a mutation to the log, then take a checkpoint
+        of the accounts if one is due.
+        Params:
+            - mutation: the change made
+            - accounts: the bank's accounts after the change
+        Returns:
+            - void
+        */
+        template <class A>
+        void record(const Mutation& mutation, vector<A>& accounts) {
+            add(mutation);
+            take_checkpoint_if_due(mutation.timestamp, accounts);
+        }
+
+        /*
+        Method to add many mutations to the log in order. No
+        checkpoint is taken; take_checkpoint_if_due is called once the
+        accounts are consistent with the log again.
+        Params:
+            - batch: the changes made, oldest first
+        Returns:
+            - void
+        */
+        void record_all(const vector<Mutation>& batch) {
+            for (size_t i = 0; i < batch.size(); i++) {
+                add(batch[i]);
+            }
+        }
+
+    private:
+        /*
+        Method to add a mutation to the end of the log.
+        Params:
+            - mutation: the change made
+        Returns:
+            - void
+        */
+        void add(const Mutation& mutation) {
+            LoggedMutation logged;
+            logged.timestamp = mutation.timestamp;
+            logged.accNum = mutation.accNum;
+            logged.newAccNum = mutation.newAccNum;
+            logged.holder = intern(mutation.holder);
+            logged.type = intern(mutation.type);
+            logged.previousBalance = mutation.previousBalance;
+            logged.balance = mutation.balance;
+            logged.kind = mutation.kind;
+            recent.push_back(logged);
+        }
+
+    public:
+        /*
+        Method to take a checkpoint of the accounts if enough
+        mutations have been logged since the last one.
+        Params:
+            - timestamp: time of the last mutation logged
+            - accounts: the bank's accounts
+        Returns:
+            - void
+        */
+        template <class A>
+        void take_checkpoint_if_due(long long timestamp, vector<A>& accounts) {
+            long long lastPosition = checkpoints.empty() ? 0 : checkpoints.back().position;
+            long long interval = max((long long) CHECKPOINT_INTERVAL, (long long) accounts.size());
+            if (get_num_of_mutations() - lastPosition >= interval) {
+                take_checkpoint(timestamp, accounts);
+            }
+        }
+
+        /*
+        Method to start the log from the accounts a bank was loaded
+        with, taking them as its first checkpoint rather than logging
+        the opening of every account. Anything logged before is dropped.
+        Params:
+            - accounts: the bank's accounts
+        Returns:
+            - void
+        */
+        template <class A>
+        void begin(vector<A>& accounts) {
+            recent.clear();
+            checkpoints.clear();
+            firstRecent = 0;
+            written = 0;
+            take_checkpoint(current_time(), accounts);
+        }
+
+        /*
+        Method to save the log to a directory: the mutations and names
+        not yet written, then an index of the checkpoints and of the
+        accounts the log ends with. A log written elsewhere is first
+        copied to the directory, and is written there from then on.
+        The index is replaced only once it has been written in full.
+        Params:
+            - saveDirectory: name of the directory
+            - accounts: the bank's accounts
+        Returns:
+            - bool true if the log was saved, false otherwise.
+        */
+        template <class A>
+        bool save(string saveDirectory, vector<A>& accounts) {
+            error_code error;
+            if (saveDirectory.compare(directory) != 0) {
+                filesystem::create_directories(saveDirectory, error);
+                if (filesystem::exists(directory)) {
+                    filesystem::copy(directory, saveDirectory, filesystem::copy_options::overwrite_existing |
+                            filesystem::copy_options::recursive, error);
+                }
+                if (error) {
+                    return false;
+                }
+                if (temporary) {
+                    filesystem::remove_all(directory, error);
+                }
+                directory = saveDirectory;
+                temporary = false;
+            }
+            if (!flush()) {
+                return false;
+            }
+            long long numberOfMutations = get_num_of_mutations();
+            long long numberOfNames = names.size();
+            long long numberOfAccounts = accounts.size();
+            unsigned long long accountDigest = digest(accounts);
+            long long numberOfCheckpoints = checkpoints.size();
+            string indexName = file(MUTATION_INDEX);
+            ofstream index(indexName + TEMP_SUFFIX, ios::binary);
+            index.write(MUTATION_MAGIC, strlen(MUTATION_MAGIC));
+            index.write((char*) &numberOfMutations, sizeof(numberOfMutations));
+            index.write((char*) &numberOfNames, sizeof(numberOfNames));
+            index.write((char*) &namesBytes, sizeof(namesBytes));
+            index.write((char*) &numberOfAccounts, sizeof(numberOfAccounts));
+            index.write((char*) &accountDigest, sizeof(accountDigest));
+            index.write((char*) &numberOfCheckpoints, sizeof(numberOfCheckpoints));
+            index.write((char*) checkpoints.data(), checkpoints.size() * sizeof(Checkpoint));
+            index.close();
+            if (!index) {
+                return false;
+            }
+            filesystem::rename(indexName + TEMP_SUFFIX, indexName, error);
+            return !error;
+        }
+
+        /*
+        Method to load a log saved by save, which is then written to
+        in the same directory. Must be called before anything is
+        logged. A missing or damaged log, or one saved with accounts
+        other than the bank's, is not loaded.
+        Params:
+            - loadDirectory: name of the directory
+            - accounts: the bank's accounts
+        Returns:
+            - bool true if a log was loaded, false otherwise.
+        */
+        template <class A>
+        bool load(string loadDirectory, vector<A>& accounts) {
+            filesystem::path path(loadDirectory);
+            ifstream index((path / MUTATION_INDEX).string(), ios::binary);
+            char magic[sizeof(MUTATION_MAGIC) - 1];
+            long long numberOfMutations, numberOfNames, numberOfBytes, numberOfAccounts, numberOfCheckpoints;
+            unsigned long long accountDigest;
+            if (!index.read(magic, sizeof(magic)) || memcmp(magic, MUTATION_MAGIC, sizeof(magic)) != 0 ||
+                    !index.read((char*) &numberOfMutations, sizeof(numberOfMutations)) ||
+                    !index.read((char*) &numberOfNames, sizeof(numberOfNames)) ||
+                    !index.read((char*) &numberOfBytes, sizeof(numberOfBytes)) ||
+                    !index.read((char*) &numberOfAccounts, sizeof(numberOfAccounts)) ||
+                    !index.read((char*) &accountDigest, sizeof(accountDigest)) ||
+                    !index.read((char*) &numberOfCheckpoints, sizeof(numberOfCheckpoints)) ||
+                    numberOfMutations < 0 || numberOfNames < 0 || numberOfBytes < 0 || numberOfCheckpoints < 0 ||
+                    numberOfAccounts != (long long) accounts.size() || accountDigest != digest(accounts)) {
+                return false;
+            }
+            vector<Checkpoint> loaded(numberOfCheckpoints);
+            if (!index.read((char*) loaded.data(), loaded.size() * sizeof(Checkpoint))) {
+                return false;
+            }
+            error_code error;
+            long long logSize = numberOfMutations * sizeof(LoggedMutation);
+            if (numberOfMutations > 0 && (filesystem::file_size(path / "log", error) < (uintmax_t) logSize || error)) {
+                return false;
+            }
+            ifstream namesFile((path / "names").string(), ios::binary);
+            unordered_map<string, int> loadedNames;
+            string name;
+            for (long long i = 0; i < numberOfNames; i++) {
+                int length;
+                if (!namesFile.read((char*) &length, sizeof(length)) || length < 0) {
+                    return false;
+                }
+                name.resize(length);
+                if (!namesFile.read(&name[0], length)) {
+                    return false;
+                }
+                loadedNames[name] = i;
+            }
+            if (numberOfMutations > 0) {
+                filesystem::resize_file(path / "log", logSize, error);
+            }
+            if (numberOfNames > 0) {
+                filesystem::resize_file(path / "names", numberOfBytes, error);
+            }
+            if (error) {
+                return false;
+            }
+            if (temporary) {
+                filesystem::remove_all(directory, error);
+            }
+            recent.clear();
+            firstRecent = numberOfMutations;
+            written = numberOfMutations;
+            checkpoints.swap(loaded);
+            names.swap(loadedNames);
+            unwrittenNames.clear();
+            namesBytes = numberOfBytes;
+            directory = loadDirectory;
+            temporary = false;
+            return true;
+        }
+
+        /*
+        Method to find the balance an account had at a past time.
+        Params:
+            - accNum: account number
+            - time: time in microseconds since the epoch
+            - balance: set to the balance of the account at that time
+        Returns:
+            - bool true if the account existed at that time, false otherwise.
+        */
+        bool balance_at(int accNum, long long time, Account::Balance* balance) {
+            long long checkpoint = checkpoint_before(time);
+            bool exists = false;
+            long long position = 0;
+            if (checkpoint >= 0) {
+                exists = checkpoint_balance(checkpoint, accNum, balance);
+                position = checkpoints.at(checkpoint).position;
+            }
+            replay(position, time, [&](LoggedMutation& mutation) {
+                if (mutation.kind == MUT_MODIFY && mutation.newAccNum == accNum) {
+                    exists = true;
+                    *balance = mutation.balance;
+                } else if (mutation.accNum == accNum) {
+                    exists = mutation.kind != MUT_CLOSE && mutation.kind != MUT_MODIFY;
+                    *balance = mutation.balance;
+                }
+            });
+            return exists;
+        }
+
+        /*
+        Method to find the total balance of the bank at a past time.
+        Params:
+            - time: time in microseconds since the epoch
+        Returns:
+            - Sum of the balances of all accounts at that time.
+        */
+        double total_at(long long time) {
+            long long checkpoint = checkpoint_before(time);
+            double total = 0;
+            long long position = 0;
+            if (checkpoint >= 0) {
+                total = checkpoints.at(checkpoint).totalBalance;
+                position = checkpoints.at(checkpoint).position;
+            }
+            replay(position, time, [&](LoggedMutation& mutation) {
+                total += mutation.balance - mutation.previousBalance;
+            });
+            return total;
+        }
+};
+
+/*
+A change published on the change feed. Events live in the ring
+buffer and are overwritten in place; a slot keeps the storage of the
+holder last written to it, so publishing only allocates for a holder
+longer than any that slot has held before.
+*/
+struct CdcEvent {
+    /*Position of the change in the feed, counting dropped changes.*/
+    unsigned long long sequence;
+    /*Time of the change in microseconds since the epoch.*/
+    long long timestamp;
+    /*Kind of change (MUT_OPEN, MUT_CLOSE, MUT_MODIFY or MUT_BALANCE).*/
+    char kind;
+    /*Account number the change was made on.*/
+    int accNum;
+    /*Account number after the change.*/
+    int newAccNum;
+    /*Holder after the change.*/
+    string holder;
+    /*Type after the change.*/
+    char type[4];
+    /*Balance before the change.*/
+    Account::Balance previousBalance;
+    /*Balance after the change.*/
+    Account::Balance balance;
+};
+
+/*
+Change data capture feed. Every mutation of a bank is copied into a
+lock-free single producer, single consumer ring buffer; a background
+thread takes the events out in batches and writes them as JSON lines
+to a file (rotated once it reaches CDC_ROTATE_BYTES), a named pipe,
+or a Unix socket (a path starting with CDC_SOCKET_PREFIX).
+Publishing never waits: if the ring buffer is full, or the sink cannot
+be written to, events are dropped and an "overflow" event reporting
+the number dropped is written as soon as possible. Sequence numbers
+count dropped events too, so gaps can be seen downstream.
+*/
+class CdcPublisher {
+    private:
+        /*Private member variable for the ring buffer of events.*/
+        vector<CdcEvent> ring;
+        /*Private member variable for the next position written by the producer.*/
+        alignas(64) atomic<unsigned long long> head;
+        /*Private member variable for the next position read by the consumer.*/
+        alignas(64) atomic<unsigned long long> tail;
+        /*Private member variable counting the events dropped.*/
+        alignas(64) atomic<unsigned long long> dropped;
+        /*Private member variable for the next sequence number (producer only).*/
+        unsigned long long nextSequence;
+        /*Private member variable set to ask the consumer to finish.*/
+        atomic<bool> stopping;
+        /*Private member variable for the consumer thread.*/
+        thread consumer;
+        /*Private member variable for where events are written.*/
+        string path;
+        /*Private member variable for the open sink, or -1.*/
+        int sink;
+        /*Private member variable set when the sink is a rotated file.*/
+        bool rotating;
+        /*Private member variable for the size of the current file.*/
+        long long fileBytes;
+        /*Private member variable set when publishing a replication journal.*/
+        bool journal;
+        /*Private member variable set once the journal could not be written.*/
+        atomic<bool> failed;
+        /*Private member variable guarding the wait for room in the ring buffer.*/
+        mutex spaceLock;
+        /*Private member variable signalled when the consumer makes room or fails.*/
+        condition_variable space;
+
+        /*
+        Method to open the sink.
+        Params:
+            - void
+        Returns:
+            - bool true if the sink is open, false otherwise.
+        */
+        bool open_sink(void) {
+            struct stat info;
+            rotating = false;
+            if (path.compare(0, strlen(CDC_SOCKET_PREFIX), CDC_SOCKET_PREFIX) == 0) {
+                string socketPath = path.substr(strlen(CDC_SOCKET_PREFIX));
+                sockaddr_un address = {};
+                address.sun_family = AF_UNIX;
+                strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+                sink = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (sink >= 0 && connect(sink, (sockaddr*) &address, sizeof(address)) != 0) {
+                    close(sink);
+                    sink = -1;
+                }
+            } else if (stat(path.c_str(), &info) == 0 && S_ISFIFO(info.st_mode)) {
+                sink = open(path.c_str(), O_WRONLY | O_NONBLOCK);
+                if (sink >= 0) {
+                    fcntl(sink, F_SETFL, fcntl(sink, F_GETFL) & ~O_NONBLOCK);
+                }
+            } else {
+                sink = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+                rotating = !journal;
+                fileBytes = sink >= 0 && fstat(sink, &info) == 0 ? info.st_size : 0;
+            }
+            return sink >= 0;
+        }
+
+        /*
+        Method to move the current file aside (path.1, path.2, ...
+        keeping CDC_ROTATE_KEEP old files) and start a new one.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void rotate(void) {
+            close(sink);
+            for (int i = CDC_ROTATE_KEEP - 1; i >= 1; i--) {
+                rename((path + "." + to_string(i)).c_str(), (path + "." + to_string(i + 1)).c_str());
+            }
+            rename(path.c_str(), (path + ".1").c_str());
+            open_sink();
+        }
+
+        /*
+        Method to write a batch of events to the sink, opening the
+        sink again if needed. Events that cannot be written are
+        counted as dropped; for a journal, the journal is marked as
+        failed instead.
+        Params:
+            - batch: the JSON lines to write
+            - numberOfEvents: number of events in the batch
+        Returns:
+            - void
+        */
+        void write_batch(string& batch, unsigned long long numberOfEvents) {
+            if (sink < 0 && !open_sink()) {
+                fail(numberOfEvents);
+                return;
+            }
+            size_t written = 0;
+            while (written < batch.size()) {
+                ssize_t result = write(sink, batch.data() + written, batch.size() - written);
+                if (result <= 0) {
+                    close(sink);
+                    sink = -1;
+                    fail(numberOfEvents);
+                    return;
+                }
+                written += result;
+            }
+            fileBytes += written;
+            if (rotating && fileBytes >= CDC_ROTATE_BYTES) {
+                rotate();
+            }
+        }
+
+        /*
+        Method to account for events that could not be written. They
+        are counted as dropped, unless publishing a journal, which
+        then fails: followers must see every change, so the journal
+        takes no more events.
+        Params:
+            - numberOfEvents: number of events not written
+        Returns:
+            - void
+        */
+        void fail(unsigned long long numberOfEvents) {
+            if (!journal) {
+                dropped += numberOfEvents;
+                return;
+            }
+            {
+                lock_guard<mutex> guard(spaceLock);
+                failed.store(true);
+            }
+            space.notify_one();
+        }
+
+        /*
+        Method to add an event to a batch as a JSON line.
+        Params:
+            - event: the event
+            - batch: string to add the line to
+        Returns:
+            - void
+        */
+        static void format_event(CdcEvent& event, string& batch) {
+            const char* kind = "balance";
+            switch (event.kind) {
+                case MUT_OPEN: kind = "open"; break;
+                case MUT_CLOSE: kind = "close"; break;
+                case MUT_MODIFY: kind = "modify"; break;
+            }
+            batch += "{\"seq\":" + to_string(event.sequence) + ",\"time\":" +
+                    to_string(event.timestamp) + ",\"event\":\"" + kind + "\",\"account\":" +
+                    to_string(event.accNum);
+            if (event.kind != MUT_CLOSE) {
+                batch += ",\"newAccount\":" + to_string(event.newAccNum) + ",\"holder\":\"" +
+                        event.holder + "\",\"type\":\"" + event.type + "\"";
+            }
+            batch += ",\"previousBalance\":" + to_string(event.previousBalance) +
+                    ",\"balance\":" + to_string(event.balance) + "}\n";
+        }
+
+        /*
+        Method run by the consumer thread. Takes events out of the
+        ring buffer in batches and writes them, until asked to stop
+        and the ring buffer is empty.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void run(void) {
+            string batch;
+            unsigned long long reported = 0;
+            while (true) {
+                bool finishing = stopping.load(memory_order_acquire);
+                unsigned long long position = tail.load(memory_order_relaxed);
+                unsigned long long end = head.load(memory_order_acquire);
+                unsigned long long numberOfEvents = 0;
+                for (; position != end && batch.size() < CDC_BATCH_BYTES; position++) {
+                    format_event(ring[position & (CDC_RING_SIZE - 1)], batch);
+                    numberOfEvents++;
+                }
+                if (journal) {
+                    {
+                        lock_guard<mutex> guard(spaceLock);
+                        tail.store(position, memory_order_release);
+                    }
+                    space.notify_one();
+                } else {
+                    tail.store(position, memory_order_release);
+                }
+                unsigned long long lost = dropped.load(memory_order_relaxed);
+                if (lost != reported) {
+                    batch += "{\"event\":\"overflow\",\"time\":" + to_string(current_time()) +
+                            ",\"dropped\":" + to_string(lost - reported) + "}\n";
+                    reported = lost;
+                }
+                if (!batch.empty()) {
+                    write_batch(batch, numberOfEvents);
+                    batch.clear();
+                    if (failed.load()) {
+                        break;
+                    }
+                    continue;
+                }
+                if (finishing) {
+                    break;
+                }
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        }
+
+    public:
+        CdcPublisher(void) : ring(CDC_RING_SIZE), head(0), tail(0), dropped(0), stopping(false), failed(false) {
+            nextSequence = 1;
+            sink = -1;
+            rotating = false;
+            fileBytes = 0;
+            journal = false;
+        }
+
+        /*
+        Writes out every event still in the ring buffer and stops
+        the consumer thread.
+        */
+        ~CdcPublisher(void) {
+            stop();
+        }
+
+        /*
+        Method to start publishing to a sink.
+        Params:
+            - path: file, named pipe, or CDC_SOCKET_PREFIX followed by
+            the path of a Unix socket.
+            - journal: true to publish a replication journal. A journal
+            file is replaced by a new, empty file (so followers can tell
+            the primary has restarted) and never rotated, and publishing
+            waits for room in the ring buffer rather than dropping
+            events, so followers see every change.
+        Returns:
+            - bool true if the sink could be opened, false otherwise.
+        */
+        bool start(string path, bool journal = false) {
+            this->path = path;
+            this->journal = journal;
+            signal(SIGPIPE, SIG_IGN);
+            struct stat info;
+            if (journal && (stat(path.c_str(), &info) != 0 || S_ISREG(info.st_mode))) {
+                unlink(path.c_str());
+            }
+            if (!open_sink()) {
+                return false;
+            }
+            consumer = thread(&CdcPublisher::run, this);
+            return true;
+        }
+
+        /*
+        Method to write out every event still in the ring buffer and
+        stop the consumer thread. Does nothing if not started.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void stop(void) {
+            if (!consumer.joinable()) {
+                return;
+            }
+            stopping.store(true, memory_order_release);
+            consumer.join();
+            if (sink >= 0) {
+                close(sink);
+                sink = -1;
+            }
+        }
+
+        /*
+        Method to publish a mutation. Only one thread may publish at
+        a time. Never waits unless publishing a journal: the event is
+        dropped if the ring buffer is full. A journal waits for the
+        consumer to make room instead.
+        Params:
+            - mutation: the change made
+        Returns:
+            - bool false if the change could not be journaled because
+            the journal can no longer be written, true otherwise.
+        */
+        bool publish(Mutation& mutation) {
+            unsigned long long position = head.load(memory_order_relaxed);
+            if (journal) {
+                unique_lock<mutex> guard(spaceLock);
+                space.wait(guard, [this, position]() {
+                    return failed.load() || position - tail.load(memory_order_acquire) != CDC_RING_SIZE;
+                });
+                if (failed.load()) {
+                    return false;
+                }
+            }
+            unsigned long long sequence = nextSequence++;
+            if (position - tail.load(memory_order_acquire) == CDC_RING_SIZE) {
+                dropped.fetch_add(1, memory_order_relaxed);
+                return true;
+            }
+            CdcEvent& event = ring[position & (CDC_RING_SIZE - 1)];
+            event.sequence = sequence;
+            event.timestamp = mutation.timestamp;
+            event.kind = mutation.kind;
+            event.accNum = mutation.accNum;
+            event.newAccNum = mutation.newAccNum;
+            event.holder.assign(mutation.holder);
+            strncpy(event.type, mutation.type.c_str(), sizeof(event.type) - 1);
+            event.type[sizeof(event.type) - 1] = '\0';
+            event.previousBalance = mutation.previousBalance;
+            event.balance = mutation.balance;
+            head.store(position + 1, memory_order_release);
+            return true;
+        }
+};
+
+/*
+One generation of remembered transaction IDs: a Bloom filter in front
+of the exact set of IDs. Most new IDs miss in the Bloom filter, so only
+IDs that are probably duplicates are looked up in the set.
+*/
+struct TransactionIdGeneration {
+    /*Bits of the Bloom filter.*/
+    vector<unsigned long long> bloom;
+    /*Every ID in this generation.*/
+    unordered_set<string> ids;
+
+    /*
+    Method to test the Bloom filter for a hash.
+    Params:
+        - hash: hash of the ID
+    Returns:
+        - bool false if the ID is certainly not in this generation.
+    */
+    bool maybe_contains(unsigned long long hash) {
+        if (bloom.empty()) {
+            return false;
+        }
+        unsigned long long step = (hash >> 32) | 1;
+        for (int i = 0; i < TXID_BLOOM_HASHES; i++) {
+            unsigned long long bit = (hash + i * step) & (TXID_BLOOM_BITS - 1);
+            if ((bloom[bit / 64] & (1ULL << (bit % 64))) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+    Method to add an ID to this generation. The Bloom filter and the
+    set are only allocated once the first ID is added, so a bank that
+    never takes postings does not pay for them.
+    Params:
+        - id: the ID
+        - hash: hash of the ID
+    Returns:
+        - void
+    */
+    void add(const string& id, unsigned long long hash) {
+        if (bloom.empty()) {
+            bloom.resize(TXID_BLOOM_BITS / 64);
+            ids.reserve(TXID_GENERATION_SIZE);
+        }
+        unsigned long long step = (hash >> 32) | 1;
+        for (int i = 0; i < TXID_BLOOM_HASHES; i++) {
+            unsigned long long bit = (hash + i * step) & (TXID_BLOOM_BITS - 1);
+            bloom[bit / 64] |= 1ULL << (bit % 64);
+        }
+        ids.insert(id);
+    }
+
+    /*
+    Method to forget every ID in this generation.
+    Params:
+        - void
+    Returns:
+        - void
+    */
+    void clear(void) {
+        fill(bloom.begin(), bloom.end(), 0);
+        ids.clear();
+    }
+};
+
+/*
+Window of the most recent client supplied transaction IDs, used to
+make retried postings no-ops. IDs are kept in two generations: new IDs
+go into the current one, and once it holds TXID_GENERATION_SIZE IDs
+the previous generation is forgotten and the current one takes its
+place. Between one and two generations of IDs are always remembered.
+*/
+class TransactionIds {
+    private:
+        /*Private member variable for the generation IDs are added to.*/
+        TransactionIdGeneration current;
+        /*Private member variable for the generation before it.*/
+        TransactionIdGeneration previous;
+
+        /*
+        Method to hash an ID (FNV-1a, then mixed so every bit of the
+        result depends on every byte of the ID).
+        Params:
+            - id: the ID
+        Returns:
+            - The hash.
+        */
+        static unsigned long long hash(const string& id) {
+            unsigned long long hash = 14695981039346656037ULL;
+            for (unsigned char c : id) {
+                hash = (hash ^ c) * 1099511628211ULL;
+            }
+            hash ^= hash >> 33;
+            hash *= 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 33;
+            return hash;
+        }
+
+    public:
+        /*
+        Method to check whether an ID is still remembered.
+        Params:
+            - id: the ID
+        Returns:
+            - bool true if the ID has been seen, false otherwise.
+        */
+        bool contains(const string& id) {
+            unsigned long long idHash = hash(id);
+            return (current.maybe_contains(idHash) && current.ids.count(id) != 0) ||
+                    (previous.maybe_contains(idHash) && previous.ids.count(id) != 0);
+        }
+
+        /*
+        Method to remember an ID, forgetting the oldest generation if
+        the current one is full.
+        Params:
+            - id: the ID
+        Returns:
+            - void
+        */
+        void add(const string& id) {
+            if (current.ids.size() >= TXID_GENERATION_SIZE) {
+                swap(current, previous);
+                current.clear();
+            }
+            current.add(id, hash(id));
+        }
+
+        /*
+        Method to write the remembered IDs to a file, one per line:
+        the IDs of the previous generation, an empty line, then the
+        IDs of the current generation. Within a generation the IDs
+        are in no particular order.
+        Params:
+            - fileName: name of the file
+        Returns:
+            - bool false if the file could not be written, true otherwise.
+        */
+        bool save(string fileName) {
+            ofstream file(fileName);
+            for (const string& id : previous.ids) {
+                file << id << '\n';
+            }
+            file << '\n';
+            for (const string& id : current.ids) {
+                file << id << '\n';
+            }
+            file.close();
+            return !file.fail();
+        }
+
+        /*
+        Method to remember every ID in a file written by save, each
+        in the generation it was saved in. A file without the empty
+        line between the generations is read as one generation. A
+        missing file is treated as empty.
+        Params:
+            - fileName: name of the file
+        Returns:
+            - void
+        */
+        void load(string fileName) {
+            ifstream file(fileName);
+            string id;
+            bool marked = false;
+            while (getline(file, id)) {
+                if (id.empty()) {
+                    marked = true;
+                } else if (marked) {
+                    current.add(id, hash(id));
+                } else {
+                    previous.add(id, hash(id));
+                }
+            }
+            if (!marked) {
+                swap(current, previous);
+            }
+        }
+};
+
+/*
+Index from account numbers to positions in a bank's accounts: an open
+addressing hash table with linear probing, kept at most half full.
+Entries are stored inline in one array, so a lookup is usually a
+single cache miss, and find_batch overlaps the misses of many lookups
+by prefetching a group of buckets before probing any of them. Account
+numbers are positive, so a key of 0 marks an empty bucket. Erasing
+shifts the following entries back instead of leaving tombstones.
+Iterators are invalidated by any insert or erase.
+*/
+class AccountIndex {
+    public:
+        /*An account number and its position.*/
+        struct Entry {
+            /*Account number, or 0 if the bucket is empty.*/
+            int first;
+            /*Position of the account.*/
+            int second;
+        };
+        typedef Entry* iterator;
+
+    private:
+        /*Private member variable for the buckets.*/
+        vector<Entry> buckets;
+        /*Private member variable for the number of accounts indexed.*/
+        size_t numberOfEntries;
+        /*Private member variable for the number of buckets less one.*/
+        size_t mask;
+
+        /*
+        Method to return the bucket an account number hashes to.
+        Params:
+            - key: account number
+        Returns:
+            - Index of the bucket.
+        */
+        size_t home(int key) const {
+            return (size_t) (((unsigned long long) (unsigned int) key * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+        }
+
+        /*
+        Method to rebuild the table with a number of buckets.
+        Params:
+            - capacity: number of buckets, a power of two
+        Returns:
+            - void
+        */
+        void rehash(size_t capacity) {
+            vector<Entry> old(capacity, Entry{0, 0});
+            old.swap(buckets);
+            mask = capacity - 1;
+            for (size_t i = 0; i < old.size(); i++) {
+                if (old[i].first != 0) {
+                    size_t bucket = home(old[i].first);
+                    while (buckets[bucket].first != 0) {
+                        bucket = (bucket + 1) & mask;
+                    }
+                    buckets[bucket] = old[i];
+                }
+            }
+        }
+
+    public:
+        AccountIndex(void) : buckets(INDEX_MIN_CAPACITY, Entry{0, 0}) {
+            numberOfEntries = 0;
+            mask = INDEX_MIN_CAPACITY - 1;
+        }
+
+        /*
+        Method to make room for a number of accounts.
+        Params:
+            - count: number of accounts
+        Returns:
+            - void
+        */
+        void reserve(size_t count) {
+            size_t capacity = buckets.size();
+            while (capacity < count * 2) {
+                capacity *= 2;
+            }
+            if (capacity != buckets.size()) {
+                rehash(capacity);
+            }
+        }
+
+        /*
+        Method to find the entry of an account number.
+        Params:
+            - key: account number
+        Returns:
+            - Iterator to the entry, or end() if not indexed.
+        */
+        iterator find(int key) {
+            size_t bucket = home(key);
+            while (buckets[bucket].first != 0) {
+                if (buckets[bucket].first == key) {
+                    return &buckets[bucket];
+                }
+                bucket = (bucket + 1) & mask;
+            }
+            return end();
+        }
+
+        /*
+        Method to find the positions of many account numbers at once.
+        The buckets of each group of LOOKUP_GROUP numbers are
+        prefetched before any of them are probed.
+        Params:
+            - keys: account numbers
+            - count: number of account numbers
+            - values: set to the position of each account, or
+            LOOKUP_NOT_FOUND
+        Returns:
+            - void
+        */
+        void find_batch(const int* keys, size_t count, int* values) {
+            size_t homes[LOOKUP_GROUP];
+            for (size_t start = 0; start < count; start += LOOKUP_GROUP) {
+                size_t end = min(count, start + LOOKUP_GROUP);
+                for (size_t i = start; i < end; i++) {
+                    homes[i - start] = home(keys[i]);
+                    __builtin_prefetch(&buckets[homes[i - start]]);
+                }
+                for (size_t i = start; i < end; i++) {
+                    size_t bucket = homes[i - start];
+                    values[i] = LOOKUP_NOT_FOUND;
+                    while (buckets[bucket].first != 0) {
+                        if (buckets[bucket].first == keys[i]) {
+                            values[i] = buckets[bucket].second;
+                            break;
+                        }
+                        bucket = (bucket + 1) & mask;
+                    }
+                }
+            }
+        }
+
+        /*
+        Method to return the iterator for numbers not indexed.
+        Params:
+            - void
+        Returns:
+            - The end iterator.
+        */
+        iterator end(void) {
+            return NULL;
+        }
+
+        /*
+        Method to count the entries of an account number.
+        Params:
+            - key: account number
+        Returns:
+            - 1 if the account is indexed, 0 otherwise.
+        */
+        size_t count(int key) {
+            return find(key) != end() ? 1 : 0;
+        }
+
+        /*
+        Method to return the position of an account number, indexing
+        it if needed.
+        Params:
+            - key: account number
+        Returns:
+            - Reference to the position.
+        */
+        int& operator[](int key) {
+            iterator found = find(key);
+            if (found != end()) {
+                return found->second;
+            }
+            if ((numberOfEntries + 1) * 2 > buckets.size()) {
+                rehash(buckets.size() * 2);
+            }
+            size_t bucket = home(key);
+            while (buckets[bucket].first != 0) {
+                bucket = (bucket + 1) & mask;
+            }
+            buckets[bucket] = Entry{key, 0};
+            numberOfEntries++;
+            return buckets[bucket].second;
+        }
+
+        /*
+        Method to remove an entry, moving back any following entries
+        that would no longer be found.
+        Params:
+            - entry: iterator to the entry
+        Returns:
+            - void
+        */
+        void erase(iterator entry) {
+            size_t hole = entry - buckets.data();
+            size_t bucket = (hole + 1) & mask;
+            while (buckets[bucket].first != 0) {
+                size_t wanted = home(buckets[bucket].first);
+                if (((bucket - wanted) & mask) >= ((bucket - hole) & mask)) {
+                    buckets[hole] = buckets[bucket];
+                    hole = bucket;
+                }
+                bucket = (bucket + 1) & mask;
+            }
+            buckets[hole].first = 0;
+            numberOfEntries--;
+        }
+
+        /*
+        Method to remove the entry of an account number, if indexed.
+        Params:
+            - key: account number
+        Returns:
+            - void
+        */
+        void erase(int key) {
+            iterator found = find(key);
+            if (found != end()) {
+                erase(found);
+            }
+        }
+
+        /*
+        Method to remove every entry.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void clear(void) {
+            fill(buckets.begin(), buckets.end(), Entry{0, 0});
+            numberOfEntries = 0;
+        }
+};
+
+/*
+Condition selecting the accounts changed by a bulk update. An
+account matches if it meets every part of the condition.
+*/
+struct BulkPredicate {
+    /*Smallest matching account number.*/
+    int minNumber;
+    /*Largest matching account number.*/
+    int maxNumber;
+    /*Matching account type, or empty for any type.*/
+    string type;
+    /*Set if only accounts of one holder match.*/
+    bool matchHolder;
+    /*Matching holder when matchHolder is set.*/
+    string holder;
+    /*Balances must be above (or, if minInclusive, equal to) this.*/
+    float minBalance;
+    /*Set if minBalance itself matches.*/
+    bool minInclusive;
+    /*Balances must be below (or, if maxInclusive, equal to) this.*/
+    float maxBalance;
+    /*Set if maxBalance itself matches.*/
+    bool maxInclusive;
+};
+
+/*
+Changes made by a bulk update to every matching account.
+*/
+struct BulkUpdate {
+    /*Set if the type is changed.*/
+    bool setType;
+    /*New type.*/
+    string type;
+    /*Set if the holder is changed.*/
+    bool setHolder;
+    /*New holder.*/
+    string holder;
+    /*Set if the balance is changed.*/
+    bool setBalance;
+    /*New balance.*/
+    Account::Balance balance;
+};
+
+/*
+Result of a bulk update.
+*/
+struct BulkSummary {
+    /*Account numbers of the accounts changed, in the bank's order.*/
+    vector<int> accounts;
+    /*Sum of the changed accounts' balances before the update.*/
+    double balanceBefore;
+    /*Sum of the changed accounts' balances after the update.*/
+    double balanceAfter;
+};
+
+/*
+Exception to handle when a bulk update would break the rules of
+the bank. No account is changed when it is thrown.
+*/
+struct InvalidUpdateException : public std::exception {
+    const char* what() const throw() {
+        return "Update would break the rules of the bank";
+    }
+};
+
+/*
+Exception to handle when more accounts are looked up at once than a
+lazy bank can hold in memory together.
+*/
+struct BatchTooLargeException : public std::exception {
+    const char* what() const throw() {
+        return "Too many accounts looked up at once";
+    }
+};
+
+class LazySource;
+
+/*
+Class to represent a single bank object that holds multiple
+account objects. A bank opened lazily only holds the accounts
+that have been used; the rest are read from its savefile on demand.
+The rules, balance representation and locking come from the Policy.
+*/
+template <class Policy>
+class BasicBank {
+    public:
+        /*Accounts held by this bank.*/
+        typedef BasicAccount<Policy> Account;
+        /*Representation of balances.*/
+        typedef typename Account::Balance Balance;
+        /*Balances of the bank's hot accounts.*/
+        typedef HotBalance<Balance> Hot;
+
+    private:
+        /*Private member variable for the lock held by every operation.*/
+        typename Policy::Lock lock;
+        /*Private member variable vector to store the bank accounts.*/
+        vector<Account> accounts;
+        /*Private member variable to track the number of accounts stored for this bank.*/
+        int numberOfAccounts;
+        /*Private member variable mapping each account number to its position in accounts.*/
+        AccountIndex slots;
+        /*Private member variable to store the deposits and withdrawals made.*/
+        TransactionHistory history;
+        /*Private member variable to store every change made to the accounts.*/
+        MutationLog mutationLog;
+        /*Private member variable for the savefile of a lazily opened bank, or null.*/
+        LazySource* source;
+        /*Private member variable for the change feed, or null.*/
+        CdcPublisher* cdc;
+        /*Private member variable for the IDs of the postings recently applied.*/
+        TransactionIds transactionIds;
+        /*Private member variable owning the balances of hot accounts.*/
+        deque<Hot> hotBalances;
+        /*Private member variable mapping account numbers to their hot balance.*/
+        unordered_map<int, Hot*> hot;
+
+        /*
+        Method to deposit into, or withdraw from, the account at a
+        position, recording it in the account's history. The pending
+        deposits of a hot account are folded first, so the amount goes
+        to its settled balance and is recorded exactly once.
+        Params:
+            - position: position of the account, or LOOKUP_NOT_FOUND
+            - amount: amount to deposit, or to withdraw if negative
+        Returns:
+            - BATCH_OK, BATCH_NOT_FOUND or BATCH_NEGATIVE_BALANCE.
+        */
+        int apply_at(int position, Balance amount) {
+            if (position == LOOKUP_NOT_FOUND) {
+                return BATCH_NOT_FOUND;
+            }
+            Account* account = &accounts[position];
+            int number = account->get_acc_num();
+            fold_hot(account);
+            Balance previousBalance = account->get_balance();
+            if (amount < 0) {
+                if (!Policy::Overdraft::allows(previousBalance, -amount)) {
+                    return BATCH_NEGATIVE_BALANCE;
+                }
+                account->decrease_balance(-amount);
+                history.record(number, TXN_WITHDRAW, -amount, account->get_balance());
+            } else {
+                account->increase_balance(amount);
+                history.record(number, TXN_DEPOSIT, amount, account->get_balance());
+            }
+            source_changed(number);
+            log_mutation(MUT_BALANCE, number, account, previousBalance);
+            return BATCH_OK;
+        }
+
+        /*
+        Method to deposit into, or withdraw from, many accounts in
+        order. The accounts are looked up together with lookup_batch,
+        and each account is prefetched a few postings ahead. A lazy
+        bank works through the postings LAZY_BATCH_SIZE at a time.
+        Params:
+            - numbers: account numbers
+            - amounts: amount to deposit into each account, or to
+            withdraw if negative
+            - count: number of postings
+            - statuses: set to the status of each posting (BATCH_OK,
+            BATCH_NOT_FOUND or BATCH_NEGATIVE_BALANCE)
+        Returns:
+            - void
+        */
+        void apply_batch(const int* numbers, const Balance* amounts, size_t count, int* statuses) {
+            typename Policy::Lock::Guard guard(lock);
+            if (source != NULL && count > LAZY_BATCH_SIZE) {
+                for (size_t start = 0; start < count; start += LAZY_BATCH_SIZE) {
+                    apply_batch(numbers + start, amounts + start,
+                            min(count - start, (size_t) LAZY_BATCH_SIZE), statuses + start);
+                }
+                return;
+            }
+            vector<int> positions(count);
+            lookup_batch(numbers, count, positions.data());
+            for (size_t i = 0; i < count; i++) {
+                if (i + BATCH_PREFETCH_DISTANCE < count &&
+                        positions[i + BATCH_PREFETCH_DISTANCE] != LOOKUP_NOT_FOUND) {
+                    __builtin_prefetch(&accounts[positions[i + BATCH_PREFETCH_DISTANCE]]);
+                }
+                statuses[i] = apply_at(positions[i], amounts[i]);
+            }
+        }
+
+        /*
+        Method to fold the pending deposits of a hot account into its
+        balance, recording them as one deposit.
+        Params:
+            - account: the account
+        Returns:
+            - void
+        */
+        void fold_hot(Account* account) {
+            Balance merged = account->fold_deposits();
+            if (merged == 0) {
+                return;
+            }
+            int number = account->get_acc_num();
+            source_changed(number);
+            history.record(number, TXN_DEPOSIT, merged, account->get_balance());
+            log_mutation(MUT_BALANCE, number, account, account->get_balance() - merged);
+        }
+
+        Account* fault_in(int number);
+        bool in_source(int number);
+        void source_added(int number);
+        void source_removed(int number);
+        void source_changed(int number);
+
+        /*
+        Method to add a change to the mutation log and publish it on
+        the change feed. Lazy banks keep no mutation log, but still
+        publish their changes. If the change cannot be journaled the
+        program exits, so the bank does not go on without its followers.
+        Params:
+            - kind: kind of change
+            - accNum: account number the change was made on
+            - account: the account after the change, or null if
+            the account was closed
+            - previousBalance: balance before the change
+        Returns:
+            - void
+        */
+        void log_mutation(char kind, int accNum, Account* account, Balance previousBalance) {
+            if (source != NULL && cdc == NULL) {
+                return;
+            }
+            Mutation mutation = describe_mutation(kind, accNum, account, previousBalance);
+            if (cdc != NULL && !cdc->publish(mutation)) {
+                cerr << BAD_JOURNAL << endl;
+                exit(CANNOT_OPEN_FILE);
+            }
+            if (source == NULL) {
+                mutationLog.record(mutation, accounts);
+            }
+        }
+
+        /*
+        Method to add many changes to the mutation log and publish
+        them on the change feed, as log_mutation does for one. No
+        checkpoint is taken, so the accounts may still be changing.
+        Params:
+            - batch: the changes, oldest first
+        Returns:
+            - void
+        */
+        void log_mutations(vector<Mutation>& batch) {
+            if (source != NULL && cdc == NULL) {
+                return;
+            }
+            for (size_t i = 0; cdc != NULL && i < batch.size(); i++) {
+                if (!cdc->publish(batch[i])) {
+                    cerr << BAD_JOURNAL << endl;
+                    exit(CANNOT_OPEN_FILE);
+                }
+            }
+            if (source == NULL) {
+                mutationLog.record_all(batch);
+            }
+        }
+
+        /*
+        Method to describe a change made to an account.
+        Params:
+            - kind: kind of change
+            - accNum: account number the change was made on
+            - account: the account after the change, or null if
+            the account was closed
+            - previousBalance: balance before the change
+        Returns:
+            - The mutation.
+        */
+        Mutation describe_mutation(char kind, int accNum, Account* account, Balance previousBalance) {
+            Mutation mutation;
+            mutation.timestamp = current_time();
+            mutation.kind = kind;
+            mutation.accNum = accNum;
+            mutation.newAccNum = accNum;
+            mutation.previousBalance = previousBalance;
+            mutation.balance = 0;
+            if (account != NULL) {
+                mutation.newAccNum = account->get_acc_num();
+                mutation.holder = account->get_holder();
+                mutation.type = account->get_type();
+                mutation.balance = account->get_balance();
+            }
+            return mutation;
+        }
+
+    public:
+        /*Public member variable to store the name of the bank.*/
+        string name;
+
+        /*
+        Instantiates a new Bank Object with the specified name
+        Params:
+            - name: name of the bank.
+        */
+        BasicBank(string name) {
+            this->name = name;
+            numberOfAccounts = 0;
+            source = NULL;
+            cdc = NULL;
+        }
+
+        /*
+        Method to publish every later change to the bank's accounts
+        on a change feed.
+        Params:
+            - publisher: the change feed, or null to stop publishing
+            - snapshot: true to first publish the opening of every
+            account, so that the feed alone can rebuild the bank
+        Returns:
+            - void
+        */
+        void attach_cdc(CdcPublisher* publisher, bool snapshot = false) {
+            typename Policy::Lock::Guard guard(lock);
+            if (publisher != NULL && snapshot) {
+                for_each_account([&](Account& account) {
+                    Mutation mutation = describe_mutation(MUT_OPEN, account.get_acc_num(), &account, 0);
+                    if (!publisher->publish(mutation)) {
+                        cerr << BAD_JOURNAL << endl;
+                        exit(CANNOT_OPEN_FILE);
+                    }
+                });
+            }
+            cdc = publisher;
+        }
+
+        ~BasicBank(void);
+
+        bool is_lazy(void);
+        void open_source(string fileName, int numberOfFileAccounts);
+        void load_all(void);
+        void for_each_account(function<void(Account&)> visit);
+
+        /*
+        Method to add an account within the bank.
+        Params:
+            - number: account number of new account
+            - holder: holder of the new account
+            - type: type of the new account
+            - amount: initial balance of the account
+        Returns:
+            - void
+        */
+        void add_account(int number, string holder, string type, Balance amount) {
+            typename Policy::Lock::Guard guard(lock);
+            load_account(number, holder, type, amount);
+            log_mutation(MUT_OPEN, number, &accounts.back(), 0);
+        }
+
+        /*
+        Method to add an account read from a savefile. Unlike
+        add_account the account is not logged as a change; the
+        accounts loaded are the starting point of the mutation log
+        once load_history is called.
+        Params:
+            - number: account number of the account
+            - holder: holder of the account
+            - type: type of the account
+            - amount: balance of the account
+        Returns:
+            - void
+        Throws:
+            - AccountAlreadyExistsException
+        */
+        void load_account(int number, string holder, string type, Balance amount) {
+            typename Policy::Lock::Guard guard(lock);
+            if (slots.count(number) != 0 || in_source(number)) {
+                throw AccountAlreadyExistsException();
+            }
+            slots[number] = accounts.size();
+            accounts.push_back(Account(number, holder, type, amount));
+            numberOfAccounts++;
+            source_added(number);
+        }
+
+        /*
+        Given an account number, this method finds that account stored
+        within the bank and returns a pointer to that object. If no
+        such account exists with such an account number in the bank, an
+        AccountNotFoundException is thrown. The lock is released before
+        returning, and adding, closing or reading in an account can move
+        the others, so where other threads share the bank the pointer is
+        only safe to use while the caller keeps them out of the bank;
+        otherwise use copy_account.
+        Params:
+            - number: Account number
+        Returns:
+            - Pointer to the account object
+        Throws:
+            - AccountNotFoundException
+        */
+        Account* get_account(int number) {
+            typename Policy::Lock::Guard guard(lock);
+            AccountIndex::iterator slot = slots.find(number);
+            if (slot != slots.end()) {
+                return &accounts.at(slot->second);
+            }
+            Account* account = fault_in(number);
+            if (account == NULL) {
+                throw AccountNotFoundException();
+            }
+            return account;
+        }
+
+        /*
+        Method to copy an account while holding the lock, so it can be
+        read safely while other threads use the bank.
+        Params:
+            - number: Account number
+        Returns:
+            - A copy of the account object
+        Throws:
+            - AccountNotFoundException
+        */
+        Account copy_account(int number) {
+            typename Policy::Lock::Guard guard(lock);
+            return *get_account(number);
+        }
+
+        /*
+        Method to find the positions of many accounts at once. Unlike
+        get_account, a missing account is reported rather than thrown,
+        and the cache misses of the lookups overlap. A lazy bank first
+        reads in just the accounts it does not hold in memory; reading
+        one can drop another, so it repeats until every account found
+        is held at once.
+        Params:
+            - numbers: account numbers
+            - count: number of account numbers (at most
+            LAZY_BATCH_SIZE on a lazy bank)
+            - positions: set to the position of each account (for
+            get_account_at), or LOOKUP_NOT_FOUND
+        Returns:
+            - void
+        Throws:
+            - BatchTooLargeException
+        */
+        void lookup_batch(const int* numbers, size_t count, int* positions) {
+            typename Policy::Lock::Guard guard(lock);
+            if (source != NULL && count > LAZY_BATCH_SIZE) {
+                throw BatchTooLargeException();
+            }
+            bool faulted = true;
+            while (faulted) {
+                slots.find_batch(numbers, count, positions);
+                faulted = false;
+                for (size_t i = 0; i < count; i++) {
+                    if (positions[i] == LOOKUP_NOT_FOUND && in_source(numbers[i])) {
+                        fault_in(numbers[i]);
+                        faulted = true;
+                    }
+                }
+            }
+        }
+
+        /*
+        Method to deposit into many accounts.
+        Params:
+            - numbers: account numbers
+            - amounts: amount to deposit into each account
+            - count: number of deposits
+            - statuses: set to BATCH_OK or BATCH_NOT_FOUND for each deposit
+        Returns:
+            - void
+        */
+        void deposit_batch(const int* numbers, const Balance* amounts, size_t count, int* statuses) {
+            apply_batch(numbers, amounts, count, statuses);
+        }
+
+        /*
+        Method to withdraw from many accounts.
+        Params:
+            - numbers: account numbers
+            - amounts: amount to withdraw from each account
+            - count: number of withdrawals
+            - statuses: set to BATCH_OK, BATCH_NOT_FOUND or
+            BATCH_NEGATIVE_BALANCE for each withdrawal
+        Returns:
+            - void
+        */
+        void withdraw_batch(const int* numbers, const Balance* amounts, size_t count, int* statuses) {
+            vector<Balance> negated(amounts, amounts + count);
+            for (size_t i = 0; i < count; i++) {
+                negated[i] = -negated[i];
+            }
+            apply_batch(numbers, negated.data(), count, statuses);
+        }
+
+        /*
+        Method to apply a batch of postings with client supplied
+        transaction IDs, in order, skipping any whose ID was recently
+        applied (including earlier in the same batch).
+        Params:
+            - ids: transaction IDs
+            - numbers: account numbers
+            - amounts: amount to deposit, or to withdraw if negative
+            - count: number of postings
+            - statuses: set to BATCH_OK, BATCH_DUPLICATE,
+            BATCH_NOT_FOUND or BATCH_NEGATIVE_BALANCE for each posting
+        Returns:
+            - void
+        */
+        void post_batch(const string* ids, const int* numbers, const Balance* amounts,
+                size_t count, int* statuses) {
+            typename Policy::Lock::Guard guard(lock);
+            if (source != NULL && count > LAZY_BATCH_SIZE) {
+                for (size_t start = 0; start < count; start += LAZY_BATCH_SIZE) {
+                    post_batch(ids + start, numbers + start, amounts + start,
+                            min(count - start, (size_t) LAZY_BATCH_SIZE), statuses + start);
+                }
+                return;
+            }
+            vector<int> positions(count);
+            lookup_batch(numbers, count, positions.data());
+            for (size_t i = 0; i < count; i++) {
+                if (i + BATCH_PREFETCH_DISTANCE < count &&
+                        positions[i + BATCH_PREFETCH_DISTANCE] != LOOKUP_NOT_FOUND) {
+                    __builtin_prefetch(&accounts[positions[i + BATCH_PREFETCH_DISTANCE]]);
+                }
+                if (transactionIds.contains(ids[i])) {
+                    statuses[i] = BATCH_DUPLICATE;
+                    continue;
+                }
+                statuses[i] = apply_at(positions[i], amounts[i]);
+                if (statuses[i] == BATCH_OK) {
+                    transactionIds.add(ids[i]);
+                }
+            }
+        }
+
+        /*
+        Method to make room for a number of accounts ahead of a
+        bulk insert, so the accounts are not moved as they are added.
+        Params:
+            - count: number of accounts the bank is expected to hold
+        Returns:
+            - void
+        */
+        void reserve(int count) {
+            accounts.reserve(count);
+            slots.reserve(count);
+        }
+
+        /*
+        Method to return the account stored at a position within
+        the bank, without copying the accounts.
+        Params:
+            - index: position of the account, from 0 to the
+            number of accounts - 1.
+        Returns:
+            - Pointer to the account object
+        */
+        Account* get_account_at(int index) {
+            load_all();
+            return &accounts.at(index);
+        }
+
+        /*
+        Method to deposit money into an account and record the
+        deposit in the account's history.
+        Params:
+            - number: account number
+            - amount: amount to deposit
+        Returns:
+            - The new balance of the account.
+        Throws:
+            - AccountNotFoundException
+        */
+        Balance deposit(int number, Balance amount) {
+            Hot* hotBalance = deposit_hot(number, amount);
+            if (hotBalance != NULL) {
+                return hotBalance->total();
+            }
+            typename Policy::Lock::Guard guard(lock);
+            Account* account = get_account(number);
+            fold_hot(account);
+            Balance previousBalance = account->get_balance();
+            account->increase_balance(amount);
+            source_changed(number);
+            history.record(number, TXN_DEPOSIT, amount, account->get_balance());
+            log_mutation(MUT_BALANCE, number, account, previousBalance);
+            return account->get_balance();
+        }
+
+        /*
+        Method to withdraw money from an account and record the
+        withdrawal in the account's history.
+        Params:
+            - number: account number
+            - amount: amount to withdraw
+        Returns:
+            - The new balance of the account.
+        Throws:
+            - AccountNotFoundException
+            - NegativeBalanceException
+        */
+        Balance withdraw(int number, Balance amount) {
+            typename Policy::Lock::Guard guard(lock);
+            Account* account = get_account(number);
+            fold_hot(account);
+            Balance previousBalance = account->get_balance();
+            account->decrease_balance(amount);
+            source_changed(number);
+            history.record(number, TXN_WITHDRAW, amount, account->get_balance());
+            log_mutation(MUT_BALANCE, number, account, previousBalance);
+            return account->get_balance();
+        }
+
+        /*
+        Method to deposit into, or withdraw from, an account and copy
+        it without releasing the lock in between, so the copy shows
+        the balance left by this change. Only deposits into a hot
+        account, which do not take the lock, can land in between.
+        Params:
+            - number: account number
+            - amount: amount to deposit, or to withdraw if negative
+        Returns:
+            - A copy of the account object
+        Throws:
+            - AccountNotFoundException
+            - NegativeBalanceException
+        */
+        Account change_and_copy(int number, Balance amount) {
+            typename Policy::Lock::Guard guard(lock);
+            if (amount < 0) {
+                withdraw(number, -amount);
+            } else {
+                deposit(number, amount);
+            }
+            return *get_account(number);
+        }
+
+        /*
+        Method to make an account hot: deposits into it are added to
+        per-thread stripes without taking the bank's lock, and only
+        folded into the balance, and recorded in its history, when
+        any other change is made to the account, its statement is
+        shown, or the bank is saved. A change feed only publishes the
+        deposits when they are folded, so a replica can lag behind
+        until then. Accounts must be made hot before the bank is shared
+        between threads. Modifying or closing the account makes it
+        an ordinary account again.
+        Params:
+            - number: account number
+        Returns:
+            - void
+        Throws:
+            - AccountNotFoundException
+        */
+        void mark_hot(int number) {
+            typename Policy::Lock::Guard guard(lock);
+            Account* account = get_account(number);
+            if (account->get_hot() != NULL) {
+                return;
+            }
+            hotBalances.emplace_back(number, account->get_holder(), account->get_type(),
+                    account->get_balance());
+            account->make_hot(&hotBalances.back());
+            hot[number] = &hotBalances.back();
+            source_changed(number);
+        }
+
+        /*
+        Method to deposit into a hot account without taking the bank's
+        lock. The deposit is recorded in the account's history when it
+        is folded into the balance.
+        Params:
+            - number: account number
+            - amount: amount to deposit
+        Returns:
+            - Pointer to the hot balance deposited into, or null if the
+            account is not hot (and nothing was deposited).
+        */
+        Hot* deposit_hot(int number, Balance amount) {
+            if (hot.empty()) {
+                return NULL;
+            }
+            typename unordered_map<int, Hot*>::iterator found = hot.find(number);
+            if (found == hot.end() || !found->second->deposit(amount)) {
+                return NULL;
+            }
+            return found->second;
+        }
+
+        /*
+        Method to fold the pending deposits of every hot account into
+        their balances.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void merge_hot(void) {
+            typename Policy::Lock::Guard guard(lock);
+            for (typename unordered_map<int, Hot*>::iterator it = hot.begin(); it != hot.end(); it++) {
+                AccountIndex::iterator slot = slots.find(it->first);
+                if (it->second->open.load() && slot != slots.end()) {
+                    fold_hot(&accounts.at(slot->second));
+                }
+            }
+        }
+
+        /*
+        Method to apply a posting with a client supplied transaction
+        ID. A posting whose ID was recently applied is skipped, so
+        retried batches of postings are only applied once. The ID is
+        only remembered if the posting succeeds.
+        Params:
+            - id: transaction ID
+            - number: account number
+            - amount: amount to deposit, or to withdraw if negative
+        Returns:
+            - bool true if the posting was applied, false if it was
+            a duplicate.
+        Throws:
+            - AccountNotFoundException
+            - NegativeBalanceException
+        */
+        bool post(const string& id, int number, Balance amount) {
+            typename Policy::Lock::Guard guard(lock);
+            if (transactionIds.contains(id)) {
+                return false;
+            }
+            if (amount < 0) {
+                withdraw(number, -amount);
+            } else {
+                deposit(number, amount);
+            }
+            transactionIds.add(id);
+            return true;
+        }
+
+        /*
+        Method to return the IDs of the postings recently applied.
+        Params:
+            - void
+        Returns:
+            - Reference to the transaction IDs.
+        */
+        TransactionIds& get_transaction_ids(void) {
+            return transactionIds;
+        }
+
+        /*
+        Method to change every detail of an account.
+        Params:
+            - number: current account number
+            - newNumber: new account number
+            - holder: new holder
+            - type: new type
+            - balance: new balance
+        Returns:
+            - void
+        Throws:
+            - AccountNotFoundException
+            - AccountAlreadyExistsException
+        */
+        void modify_account(int number, int newNumber, string holder, string type, Balance balance) {
+            typename Policy::Lock::Guard guard(lock);
+            Account* account = get_account(number);
+            if (newNumber != number && (slots.count(newNumber) != 0 || in_source(newNumber))) {
+                throw AccountAlreadyExistsException();
+            }
+            account->close_deposits();
+            fold_hot(account);
+            account->make_cold();
+            Balance previousBalance = account->get_balance();
+            int slot = slots[number];
+            slots.erase(number);
+            slots[newNumber] = slot;
+            account->set_acc_number(newNumber);
+            account->set_name(holder);
+            account->set_acc_type(type);
+            account->set_balance(balance);
+            if (newNumber != number) {
+                source_removed(number);
+                source_added(newNumber);
+                history.renumber(number, newNumber);
+            } else {
+                source_changed(number);
+            }
+            log_mutation(MUT_MODIFY, number, account, previousBalance);
+        }
+
+        /*
+        Method to run the end of day postings: interest is paid into
+        every savings account and fees are charged to every current
+        account, according to the tiers of the configuration. A fee is
+        not charged if the overdraft rule would refuse it. The
+        accounts are processed in parallel chunks; each chunk copies its
+        balances into a flat array so the rates can be worked out with
+        vectorised arithmetic, then posts the results back and builds
+        its history entries and mutations, which it adds to the
+        transaction history and mutation log together once it is done.
+        Every posting is stamped with the time the run started, and a
+        checkpoint is only considered once every chunk is done.
+        Params:
+            - config: rates and fees to apply
+        Returns:
+            - Totals of the postings made.
+        */
+        AccrualSummary run_accrual(AccrualConfig& config) {
+            typename Policy::Lock::Guard guard(lock);
+            load_all();
+            merge_hot();
+            size_t size = accounts.size();
+            long long now = current_time();
+            vector<Balance> postings(size);
+            vector<char> refused(size);
+            mutex merge;
+            parallel_for_chunks(size, ACCRUAL_CHUNK_SIZE, [&](size_t begin, size_t end) {
+                size_t count = end - begin;
+                vector<Balance> balances(count);
+                vector<char> savings(count);
+                for (size_t i = 0; i < count; i++) {
+                    balances[i] = accounts[begin + i].get_balance();
+                    savings[i] = accounts[begin + i].get_type().compare("S") == 0;
+                }
+                vector<Balance> rates(count, 0);
+                vector<Balance> fees(count, 0);
+                for (size_t t = 0; t < config.savingsTiers.size(); t++) {
+                    AccrualTier tier = config.savingsTiers[t];
+                    for (size_t i = 0; i < count; i++) {
+                        rates[i] = balances[i] >= tier.minimumBalance ? tier.rate : rates[i];
+                    }
+                }
+                for (size_t t = 0; t < config.currentTiers.size(); t++) {
+                    AccrualTier tier = config.currentTiers[t];
+                    for (size_t i = 0; i < count; i++) {
+                        fees[i] = balances[i] >= tier.minimumBalance ? tier.rate : fees[i];
+                    }
+                }
+                Balance* result = &postings[begin];
+                for (size_t i = 0; i < count; i++) {
+                    bool allowed = Policy::Overdraft::allows(balances[i], fees[i]);
+                    result[i] = savings[i] ? balances[i] * rates[i] : allowed ? -fees[i] : 0;
+                    refused[begin + i] = !savings[i] && fees[i] > 0 && !allowed;
+                }
+                vector<Transaction> chunkEntries;
+                vector<Mutation> chunkMutations;
+                chunkEntries.reserve(count);
+                chunkMutations.reserve(count);
+                for (size_t i = 0; i < count; i++) {
+                    if (result[i] == 0) {
+                        continue;
+                    }
+                    Account* account = &accounts[begin + i];
+                    if (result[i] > 0) {
+                        account->increase_balance(result[i]);
+                    } else {
+                        account->decrease_balance(-result[i]);
+                    }
+                    Transaction entry;
+                    entry.timestamp = now;
+                    entry.accNum = account->get_acc_num();
+                    entry.kind = result[i] > 0 ? TXN_INTEREST : TXN_FEE;
+                    entry.amount = result[i] > 0 ? result[i] : -result[i];
+                    entry.balance = account->get_balance();
+                    chunkEntries.push_back(entry);
+                    chunkMutations.push_back(describe_mutation(MUT_BALANCE, entry.accNum, account,
+                            balances[i]));
+                    chunkMutations.back().timestamp = now;
+                }
+                lock_guard<mutex> guard(merge);
+                history.append_all(chunkEntries);
+                log_mutations(chunkMutations);
+            });
+            if (source == NULL) {
+                mutationLog.take_checkpoint_if_due(now, accounts);
+            }
+            AccrualSummary summary = {0, 0, 0, 0, 0};
+            for (size_t i = 0; i < size; i++) {
+                if (postings[i] > 0) {
+                    summary.interestPostings++;
+                    summary.interestTotal += postings[i];
+                } else if (postings[i] < 0) {
+                    summary.feePostings++;
+                    summary.feeTotal -= postings[i];
+                } else if (refused[i]) {
+                    summary.feesSkipped++;
+                }
+            }
+            return summary;
+        }
+
+        /*
+        Method to check whether an account matches the condition of
+        a bulk update.
+        Params:
+            - account: the account to check
+            - predicate: the condition
+        Returns:
+            - bool true if the account matches, false otherwise.
+        */
+        static bool bulk_matches(Account& account, BulkPredicate& predicate) {
+            int number = account.get_acc_num();
+            Balance balance = account.get_balance();
+            if (number < predicate.minNumber || number > predicate.maxNumber ||
+                    balance < predicate.minBalance || balance > predicate.maxBalance ||
+                    (!predicate.minInclusive && balance == predicate.minBalance) ||
+                    (!predicate.maxInclusive && balance == predicate.maxBalance)) {
+                return false;
+            }
+            if (!predicate.type.empty() && account.get_type().compare(predicate.type) != 0) {
+                return false;
+            }
+            return !predicate.matchHolder || account.get_holder().compare(predicate.holder) == 0;
+        }
+
+        /*
+        Method to find the positions of every account matching the
+        condition of a bulk update. The accounts are scanned in
+        parallel chunks.
+        Params:
+            - predicate: the condition
+        Returns:
+            - Positions of the matching accounts, in the bank's order.
+        */
+        vector<int> bulk_match(BulkPredicate& predicate) {
+            typename Policy::Lock::Guard guard(lock);
+            load_all();
+            vector<vector<int>> chunks((accounts.size() + BULK_CHUNK_SIZE - 1) / BULK_CHUNK_SIZE);
+            parallel_for_chunks(accounts.size(), BULK_CHUNK_SIZE, [&](size_t begin, size_t end) {
+                vector<int>& matches = chunks[begin / BULK_CHUNK_SIZE];
+                for (size_t i = begin; i < end; i++) {
+                    if (bulk_matches(accounts[i], predicate)) {
+                        matches.push_back(i);
+                    }
+                }
+            });
+            vector<int> positions;
+            for (size_t c = 0; c < chunks.size(); c++) {
+                positions.insert(positions.end(), chunks[c].begin(), chunks[c].end());
+            }
+            return positions;
+        }
+
+        /*
+        Method to change every account matching a condition. The
+        update is checked against the rules of the bank before any
+        account is changed, so either every matching account is
+        changed or none is. Balances may be set to zero but not below.
+        Params:
+            - predicate: the condition selecting the accounts
+            - update: the changes to make
+        Returns:
+            - Summary of the accounts changed.
+        Throws:
+            - InvalidUpdateException
+        */
+        BulkSummary bulk_update(BulkPredicate& predicate, BulkUpdate& update) {
+            typename Policy::Lock::Guard guard(lock);
+            if ((update.setType && !Policy::Types::valid(update.type)) ||
+                    (update.setHolder &&
+                    !Policy::Names::valid(update.holder.data(), update.holder.length())) ||
+                    (update.setBalance && update.balance < 0)) {
+                throw InvalidUpdateException();
+            }
+            merge_hot();
+            vector<int> positions = bulk_match(predicate);
+            BulkSummary summary;
+            summary.balanceBefore = 0;
+            summary.balanceAfter = 0;
+            vector<Balance> previousBalances(positions.size());
+            parallel_for_chunks(positions.size(), BULK_CHUNK_SIZE, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    Account& account = accounts[positions[i]];
+                    previousBalances[i] = account.get_balance();
+                    if (update.setType) {
+                        account.set_acc_type(update.type);
+                    }
+                    if (update.setHolder) {
+                        account.set_name(update.holder);
+                    }
+                    if (update.setBalance) {
+                        account.set_balance(update.balance);
+                    }
+                }
+            });
+            summary.accounts.reserve(positions.size());
+            for (size_t i = 0; i < positions.size(); i++) {
+                Account* account = &accounts[positions[i]];
+                summary.accounts.push_back(account->get_acc_num());
+                summary.balanceBefore += previousBalances[i];
+                summary.balanceAfter += account->get_balance();
+                log_mutation(MUT_MODIFY, account->get_acc_num(), account, previousBalances[i]);
+            }
+            return summary;
+        }
+
+        /*
+        Method to list the positions of the accounts sorted by a key,
+        without moving the accounts. Account numbers and balances are
+        packed with the position into 64 bit pairs and radix sorted;
+        names are sorted as (name pointer, position) pairs with a
+        parallel merge sort. Accounts with equal keys stay in the
+        bank's order.
+        Params:
+            - key: SORT_BY_NUMBER, SORT_BY_NAME or SORT_BY_BALANCE
+        Returns:
+            - Positions of the accounts in sorted order, for use with
+            get_account_at.
+        */
+        vector<int> sorted_positions(int key) {
+            typename Policy::Lock::Guard guard(lock);
+            load_all();
+            size_t size = accounts.size();
+            vector<int> positions(size);
+            if (key == SORT_BY_NAME) {
+                vector<pair<const string*, int>> names(size);
+                parallel_for_chunks(size, SORT_MIN_CHUNK, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                        names[i] = make_pair(&accounts[i].get_holder(), (int) i);
+                    }
+                });
+                parallel_merge_sort(names, [](const pair<const string*, int>& a,
+                        const pair<const string*, int>& b) {
+                    return *a.first < *b.first;
+                });
+                for (size_t i = 0; i < size; i++) {
+                    positions[i] = names[i].second;
+                }
+                return positions;
+            }
+            vector<unsigned long long> keys(size);
+            parallel_for_chunks(size, SORT_MIN_CHUNK, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    unsigned int sortKey = key == SORT_BY_BALANCE ?
+                            float_sort_key(accounts[i].get_balance()) :
+                            (unsigned int) accounts[i].get_acc_num() ^ 0x80000000u;
+                    keys[i] = ((unsigned long long) sortKey << 32) | i;
+                }
+            });
+            parallel_radix_sort(keys);
+            for (size_t i = 0; i < size; i++) {
+                positions[i] = (int) (keys[i] & 0xffffffffu);
+            }
+            return positions;
+        }
+
+        /*
+        Method to find the balance an account had at a past time.
+        Params:
+            - number: account number
+            - time: time in microseconds since the epoch
+            - balance: set to the balance of the account at that time
+        Returns:
+            - bool true if the account existed at that time, false otherwise.
+        */
+        bool balance_at(int number, long long time, Balance* balance) {
+            typename Policy::Lock::Guard guard(lock);
+            return mutationLog.balance_at(number, time, balance);
+        }
+
+        /*
+        Method to find the total balance of the bank at a past time.
+        Params:
+            - time: time in microseconds since the epoch
+        Returns:
+            - Sum of the balances of all accounts at that time.
+        */
+        double total_at(long long time) {
+            typename Policy::Lock::Guard guard(lock);
+            return mutationLog.total_at(time);
+        }
+
+        /*
+        Method to return the most recent deposits and withdrawals
+        made on an account.
+        Params:
+            - number: account number
+            - count: maximum number of transactions to return
+        Returns:
+            - The transactions, newest first.
+        */
+        vector<Transaction> statement(int number, int count) {
+            typename Policy::Lock::Guard guard(lock);
+            AccountIndex::iterator slot = slots.find(number);
+            if (slot != slots.end()) {
+                fold_hot(&accounts.at(slot->second));
+            }
+            return history.recent(number, count);
+        }
+
+        /*
+        Method to save the transaction history and the mutation log
+        next to a savefile. A lazy bank keeps no mutation log, so any
+        saved with the savefile before is removed.
+        Params:
+            - fileName: name of the savefile
+        Returns:
+            - bool true if the history was saved, false otherwise.
+        */
+        bool save_history(string fileName) {
+            typename Policy::Lock::Guard guard(lock);
+            if (!history.save(fileName + HISTORY_SUFFIX)) {
+                return false;
+            }
+            if (source != NULL) {
+                error_code error;
+                filesystem::remove_all(fileName + MUTATION_SUFFIX, error);
+                return !error;
+            }
+            return mutationLog.save(fileName + MUTATION_SUFFIX, accounts);
+        }
+
+        /*
+        Method to load the transaction history and the mutation log
+        saved next to a savefile, if there are any. Without a mutation
+        log saved with these accounts, the log starts from the accounts
+        loaded. Must be called once every account has been loaded,
+        before any change is made.
+        Params:
+            - fileName: name of the savefile
+        Returns:
+            - void
+        */
+        void load_history(string fileName) {
+            typename Policy::Lock::Guard guard(lock);
+            history.load(fileName + HISTORY_SUFFIX);
+            if (source == NULL && !mutationLog.load(fileName + MUTATION_SUFFIX, accounts)) {
+                mutationLog.begin(accounts);
+            }
+        }
+
+        /*
+        Method to display all accounts to the terminal.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void display_accounts(void) {
+            for (int i = 0; i < accounts.size(); i++) {
+                accounts.at(i).display_account();;
+            }
+        }
+
+        /*
+        Method to return the vector that stores the accounts
+        Params:
+            - void
+        Returns:
+            - The vector that stores the accounts.
+        */
+        vector<Account> get_accounts(void) {
+            load_all();
+            return accounts;
+        }
+
+        /*
+        Method to return the number of accounts within the bank
+        Params:
+            - void
+        Returns:
+            - Number of accounts within the bank.
+        */
+        int get_num_of_accounts(void) {
+            return numberOfAccounts;
+        }
+
+        /*
+        Method to delete an account within the bank. If no such
+        account can be matched the requested account number than
+        an AccountNotFoundException will be thrown. A lazy bank first
+        reads in an account it does not hold in memory, so its closing
+        balance is logged and published like any other.
+        Params:
+            - accNum: number of the account to be deleted.
+        
+        */
+        void delete_account(int accNum) {
+            typename Policy::Lock::Guard guard(lock);
+            AccountIndex::iterator slot = slots.find(accNum);
+            if (slot == slots.end()) {
+                if (!in_source(accNum) || fault_in(accNum) == NULL) {
+                    throw AccountNotFoundException();
+                }
+                slot = slots.find(accNum);
+            }
+            int i = slot->second;
+            accounts.at(i).close_deposits();
+            fold_hot(&accounts.at(i));
+            accounts.at(i).make_cold();
+            Balance previousBalance = accounts.at(i).get_balance();
+            slots.erase(slot);
+            accounts.erase(accounts.begin() + i);
+            numberOfAccounts--;
+            for (int j = i; j < (int) accounts.size(); j++) {
+                slots[accounts.at(j).get_acc_num()] = j;
+            }
+            source_removed(accNum);
+            history.forget(accNum);
+            log_mutation(MUT_CLOSE, accNum, NULL, previousBalance);
+        }
+};
+
+typedef BasicBank<BankPolicy> Bank;
+
+/*
+Queue of pending operations for a single shard. Operations are
+pushed by the router and popped in order by the worker thread
+that owns the shard.
+*/
+class ShardQueue {
+    private:
+        /*Private member variable to guard the pending operations.*/
+        mutex lock;
+        /*Private member variable to wake the worker on new operations.*/
+        condition_variable ready;
+        /*Private member variable to store the pending operations.*/
+        deque<function<void()>> pending;
+        /*Private member variable set when no more operations will be pushed.*/
+        bool closed;
+
+    public:
+        /*
+        Instantiates a new empty, open queue.
+        */
+        ShardQueue(void) {
+            closed = false;
+        }
+
+        /*
+        Method to add an operation to the back of the queue.
+        Params:
+            - operation: the operation to be executed by the shard
+        Returns:
+            - void
+        */
+        void push(function<void()> operation) {
+            {
+                lock_guard<mutex> guard(lock);
+                pending.push_back(move(operation));
+            }
+            ready.notify_one();
+        }
+
+        /*
+        Method to wait for and remove the operation at the front
+        of the queue.
+        Params:
+            - operation: set to the removed operation
+        Returns:
+            - bool false once the queue is closed and drained,
+            true otherwise.
+        */
+        bool pop(function<void()>& operation) {
+            unique_lock<mutex> guard(lock);
+            ready.wait(guard, [this] { return closed || !pending.empty(); });
+            if (pending.empty()) {
+                return false;
+            }
+            operation = move(pending.front());
+            pending.pop_front();
+            return true;
+        }
+
+        /*
+        Method to close the queue. Operations already queued will
+        still be popped.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void close(void) {
+            {
+                lock_guard<mutex> guard(lock);
+                closed = true;
+            }
+            ready.notify_all();
+        }
+};
+
+/*
+A single partition of a sharded bank. The shard's Bank is only
+ever touched by the shard's own worker thread, so no locking is
+needed on the accounts themselves.
+*/
+class BankShard {
+    private:
+        /*Private member variable for the accounts owned by this shard.*/
+        Bank bank;
+        /*Private member variable for the operations waiting on this shard.*/
+        ShardQueue queue;
+        /*Private member variable for the thread that owns this shard.*/
+        thread worker;
+
+        /*
+        Method run by the worker thread. Executes queued operations
+        until the queue is closed.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void run(void) {
+            function<void()> operation;
+            while (queue.pop(operation)) {
+                operation();
+            }
+        }
+
+    public:
+        /*
+        Instantiates a new shard and starts its worker thread.
+        Params:
+            - name: name of the bank the shard belongs to.
+        */
+        BankShard(string name) : bank(name) {
+            worker = thread(&BankShard::run, this);
+        }
+
+        /*
+        Stops the worker thread once all queued operations are done.
+        */
+        ~BankShard(void) {
+            queue.close();
+            worker.join();
+        }
+
+        /*
+        Method to queue an operation against this shard's bank.
+        Exceptions thrown by the operation are passed back through
+        the returned future.
+        Params:
+            - operation: callable taking a Bank reference.
+        Returns:
+            - A future holding the result of the operation.
+        */
+        template <typename F>
+        future<typename invoke_result<F, Bank&>::type> submit(F operation) {
+            typedef typename invoke_result<F, Bank&>::type R;
+            shared_ptr<packaged_task<R()>> task = make_shared<packaged_task<R()>>(
+                    [this, operation]() { return operation(bank); });
+            future<R> result = task->get_future();
+            queue.push([task]() { (*task)(); });
+            return result;
+        }
+};
+
+/*
+Summary of the accounts held by one shard, or by the whole bank
+when the shard reports are aggregated.
+*/
+struct ShardReport {
+    /*Number of accounts held.*/
+    int numberOfAccounts;
+    /*Sum of the balances of the accounts held.*/
+    double totalBalance;
+};
+
+/*
+Exception to handle when an account cannot be closed because a
+transfer into or out of it is still in progress.
+*/
+struct TransferPendingException : public std::exception {
+    const char* what() const throw() {
+        return "Account has a transfer in progress";
+    }
+};
+
+/*
+Transfers prepared on a shard and not yet committed or aborted. Only
+ever touched by the shard's own worker thread.
+*/
+struct ShardHolds {
+    /*Funds reserved in each account for transfers out of it.*/
+    unordered_map<int, Account::Balance> reserved;
+    /*Number of transfers into each account.*/
+    unordered_map<int, int> pinned;
+
+    /*
+    Method to return whether an account has a transfer in progress.
+    Params:
+        - number: account number
+    Returns:
+        - bool true if a transfer into or out of the account is in progress.
+    */
+    bool busy(int number) {
+        return reserved.count(number) != 0 || pinned.count(number) != 0;
+    }
+
+    /*
+    Method to return the funds reserved in an account.
+    Params:
+        - number: account number
+    Returns:
+        - The funds reserved, 0 if there are none.
+    */
+    Account::Balance reserved_in(int number) {
+        unordered_map<int, Account::Balance>::iterator found = reserved.find(number);
+        return found == reserved.end() ? 0 : found->second;
+    }
+
+    /*
+    Method to release funds reserved in an account.
+    Params:
+        - number: account number
+        - amount: funds to release
+    Returns:
+        - void
+    */
+    void release(int number, Account::Balance amount) {
+        unordered_map<int, Account::Balance>::iterator found = reserved.find(number);
+        found->second -= amount;
+        if (found->second <= 0) {
+            reserved.erase(found);
+        }
+    }
+
+    /*
+    Method to unpin an account once a transfer into it is done.
+    Params:
+        - number: account number
+    Returns:
+        - void
+    */
+    void unpin(int number) {
+        if (--pinned[number] == 0) {
+            pinned.erase(number);
+        }
+    }
+};
+
+/*
+Class to represent a bank whose accounts are hash partitioned by
+account number over several shards. Each shard is owned by its own
+thread, and this class routes every operation to the shard owning
+the account. Operations on different shards run in parallel.
+*/
+class ShardedBank {
+    private:
+        /*Private member variable to store the shards.*/
+        vector<unique_ptr<BankShard>> shards;
+        /*Private member variable for the transfers in progress on each shard.*/
+        vector<ShardHolds> holds;
+
+    public:
+        /*Public member variable to store the name of the bank.*/
+        string name;
+
+        /*
+        Instantiates a new sharded bank with the specified name.
+        Params:
+            - name: name of the bank.
+            - numberOfShards: number of shards (and threads) to use.
+        */
+        ShardedBank(string name, int numberOfShards) {
+            this->name = name;
+            holds.resize(numberOfShards);
+            for (int i = 0; i < numberOfShards; i++) {
+                shards.push_back(unique_ptr<BankShard>(new BankShard(name)));
+            }
+        }
+
+        /*
+        Method to return the number of shards.
+        Params:
+            - void
+        Returns:
+            - Number of shards.
+        */
+        int get_num_of_shards(void) {
+            return shards.size();
+        }
+
+        /*
+        Method to find which shard owns an account number. Account
+        numbers are near-sequential so they are mixed before taking
+        the remainder to keep the shards evenly loaded.
+        Params:
+            - number: account number
+        Returns:
+            - Index of the owning shard.
+        */
+        int shard_of(int number) {
+            unsigned int mixed = (unsigned int) number * 2654435761u;
+            return (mixed >> 16) % shards.size();
+        }
+
+        /*
+        Method to add an account to the owning shard.
+        Params:
+            - number: account number of new account
+            - holder: holder of the new account
+            - type: type of the new account
+            - amount: initial balance of the account
+        Returns:
+            - A future that completes once the account is added.
+        Throws (through the future):
+            - AccountAlreadyExistsException
+        */
+        future<void> add_account(int number, string holder, string type, Account::Balance amount) {
+            return shards.at(shard_of(number))->submit(
+                    [number, holder, type, amount](Bank& bank) {
+                        bank.add_account(number, holder, type, amount);
+                    });
+        }
+
+        /*
+        Method to deposit into an account.
+        Params:
+            - number: account number
+            - amount: amount to deposit
+        Returns:
+            - A future holding the new balance of the account.
+        Throws (through the future):
+            - AccountNotFoundException
+        */
+        future<Account::Balance> deposit(int number, Account::Balance amount) {
+            return shards.at(shard_of(number))->submit(
+                    [number, amount](Bank& bank) {
+                        return bank.deposit(number, amount);
+                    });
+        }
+
+        /*
+        Method to withdraw from an account. Funds reserved for
+        transfers out of the account cannot be withdrawn.
+        Params:
+            - number: account number
+            - amount: amount to withdraw
+        Returns:
+            - A future holding the new balance of the account.
+        Throws (through the future):
+            - AccountNotFoundException
+            - NegativeBalanceException
+        */
+        future<Account::Balance> withdraw(int number, Account::Balance amount) {
+            ShardHolds* shardHolds = &holds.at(shard_of(number));
+            return shards.at(shard_of(number))->submit(
+                    [number, amount, shardHolds](Bank& bank) {
+                        Account::Balance available = bank.get_account(number)->get_balance() -
+                                shardHolds->reserved_in(number);
+                        if (!BankPolicy::Overdraft::allows(available, amount)) {
+                            throw NegativeBalanceException();
+                        }
+                        return bank.withdraw(number, amount);
+                    });
+        }
+
+        /*
+        Method to read the balance of an account.
+        Params:
+            - number: account number
+        Returns:
+            - A future holding the balance of the account.
+        Throws (through the future):
+            - AccountNotFoundException
+        */
+        future<Account::Balance> balance(int number) {
+            return shards.at(shard_of(number))->submit(
+                    [number](Bank& bank) {
+                        return bank.copy_account(number).get_balance();
+                    });
+        }
+
+        /*
+        Method to delete an account from the owning shard.
+        Params:
+            - number: account number
+        Returns:
+            - A future that completes once the account is deleted.
+        Throws (through the future):
+            - AccountNotFoundException
+            - TransferPendingException
+        */
+        future<void> delete_account(int number) {
+            ShardHolds* shardHolds = &holds.at(shard_of(number));
+            return shards.at(shard_of(number))->submit(
+                    [number, shardHolds](Bank& bank) {
+                        if (shardHolds->busy(number)) {
+                            throw TransferPendingException();
+                        }
+                        bank.delete_account(number);
+                    });
+        }
+
+        /*
+        Method to copy every account held by a shard.
+        Params:
+            - shard: index of the shard
+        Returns:
+            - A future holding copies of the shard's accounts.
+        */
+        future<vector<Account>> shard_accounts(int shard) {
+            return shards.at(shard)->submit([](Bank& bank) {
+                vector<Account> copies;
+                copies.reserve(bank.get_num_of_accounts());
+                for (int i = 0; i < bank.get_num_of_accounts(); i++) {
+                    copies.push_back(*bank.get_account_at(i));
+                }
+                return copies;
+            });
+        }
+
+        /*
+        Method to move money between two accounts. If both accounts
+        live on the same shard the transfer is a single operation on
+        that shard. Otherwise it runs in two phases. In the prepare
+        phase the funds are reserved in the source account, so they
+        can no longer be withdrawn, and the destination account is
+        checked and pinned, so it can no longer be closed; the two
+        shards prepare in parallel. If either fails, whatever the
+        other prepared is released and the transfer is aborted.
+        Otherwise the commit phase withdraws the reserved funds and
+        deposits them, which cannot fail. The two shards commit
+        independently, so a report taken between the commits can
+        see the funds in neither account.
+        Params:
+            - from: account number to withdraw from
+            - to: account number to deposit into
+            - amount: amount to move
+        Returns:
+            - void
+        Throws:
+            - AccountNotFoundException
+            - NegativeBalanceException
+        */
+        void transfer(int from, int to, Account::Balance amount) {
+            int fromShard = shard_of(from);
+            int toShard = shard_of(to);
+            ShardHolds* fromHolds = &holds.at(fromShard);
+            ShardHolds* toHolds = &holds.at(toShard);
+            if (fromShard == toShard) {
+                shards.at(fromShard)->submit([from, to, amount, fromHolds](Bank& bank) {
+                    bank.get_account(to);
+                    Account::Balance available = bank.get_account(from)->get_balance() -
+                            fromHolds->reserved_in(from);
+                    if (!BankPolicy::Overdraft::allows(available, amount)) {
+                        throw NegativeBalanceException();
+                    }
+                    bank.withdraw(from, amount);
+                    bank.deposit(to, amount);
+                }).get();
+                return;
+            }
+            future<void> reserve = shards.at(fromShard)->submit([from, amount, fromHolds](Bank& bank) {
+                Account::Balance available = bank.get_account(from)->get_balance() -
+                        fromHolds->reserved_in(from);
+                if (!BankPolicy::Overdraft::allows(available, amount)) {
+                    throw NegativeBalanceException();
+                }
+                fromHolds->reserved[from] += amount;
+            });
+            future<void> pin = shards.at(toShard)->submit([to, toHolds](Bank& bank) {
+                bank.get_account(to);
+                toHolds->pinned[to]++;
+            });
+            exception_ptr failure;
+            bool reserved = false;
+            bool pinned = false;
+            try {
+                reserve.get();
+                reserved = true;
+            } catch (...) {
+                failure = current_exception();
+            }
+            try {
+                pin.get();
+                pinned = true;
+            } catch (...) {
+                if (!failure) {
+                    failure = current_exception();
+                }
+            }
+            if (failure) {
+                if (reserved) {
+                    shards.at(fromShard)->submit([from, amount, fromHolds](Bank&) {
+                        fromHolds->release(from, amount);
+                    }).get();
+                }
+                if (pinned) {
+                    shards.at(toShard)->submit([to, toHolds](Bank&) {
+                        toHolds->unpin(to);
+                    }).get();
+                }
+                rethrow_exception(failure);
+            }
+            future<void> debit = shards.at(fromShard)->submit([from, amount, fromHolds](Bank& bank) {
+                fromHolds->release(from, amount);
+                bank.withdraw(from, amount);
+            });
+            future<void> credit = shards.at(toShard)->submit([to, amount, toHolds](Bank& bank) {
+                toHolds->unpin(to);
+                bank.deposit(to, amount);
+            });
+            debit.get();
+            credit.get();
+        }
+
+        /*
+        Method to summarise a single shard.
+        Params:
+            - shard: index of the shard
+        Returns:
+            - A future holding the report for that shard.
+        */
+        future<ShardReport> shard_report(int shard) {
+            return shards.at(shard)->submit([](Bank& bank) {
+                ShardReport report;
+                report.numberOfAccounts = bank.get_num_of_accounts();
+                report.totalBalance = 0;
+                for (int i = 0; i < report.numberOfAccounts; i++) {
+                    report.totalBalance += bank.get_account_at(i)->get_balance();
+                }
+                return report;
+            });
+        }
+
+        /*
+        Method to summarise the whole bank. Every shard builds its
+        own report in parallel, then the reports are added together.
+        Params:
+            - void
+        Returns:
+            - The report for all accounts in the bank.
+        */
+        ShardReport report(void) {
+            vector<future<ShardReport>> pending;
+            for (int i = 0; i < get_num_of_shards(); i++) {
+                pending.push_back(shard_report(i));
+            }
+            ShardReport total;
+            total.numberOfAccounts = 0;
+            total.totalBalance = 0;
+            for (int i = 0; i < get_num_of_shards(); i++) {
+                ShardReport part = pending.at(i).get();
+                total.numberOfAccounts += part.numberOfAccounts;
+                total.totalBalance += part.totalBalance;
+            }
+            return total;
+        }
+};
+
+/*
+Function to print how the program is used and exit.
+Params:
+    - void
+Returns:
+    - void
+*/
+void print_usage(void) {
+    cerr << "Incorrect number of arguments\n"
+         << "Usage: ./bank savefile or ./bank\n"
+         << "       ./bank --shards count savefile [commands]\n"
+         << "       ./bank --import input.csv|input.json savefile\n"
+         << "       ./bank --export savefile output.csv|output.json\n"
+         << "       ./bank --lazy savefile\n"
+         << "       ./bank --diff savefile savefile\n"
+         << "       ./bank [--hot number,...] [--cdc feed] [--lazy] [savefile]\n"
+         << "       ./bank [--hot number,...] [--journal journal] [--lazy] [savefile]\n"
+         << "       ./bank --follow journal\n"
+         << "       ./bank [--hot number,...] --serve socket savefile\n"
+         << "       ./bank --script [--json] [savefile]\n"
+         << "       ./bank --post postings.csv savefile\n";
+    exit(BAD_ARGS);
+}
+
+/*
+Function to check that the number of arguments
+put into the command line are correcnt. Function
+will exit the program if the number of args are 
+incorrect.
+Params:
+    - argc: number of arguments on the command line
+Returns:
+    - void
+*/
+void check_args(int argc) {
+    if (argc != 1 && argc != 2) {
+        print_usage();
+    }
+}
+
+/*
+Function to convert a string representation of a number
+to type int.
+Params:
+    - numStr: string representation of a number
+Returns:
+    - The number of type int. If the number is invalid or
+    too large, this function will return -1, else if the number is 
+    less then 0, it will return -2.
+*/
+int convert_string_to_int(string numStr) {
+    int number;
+    try {
+        number = stoi(numStr);
+    } catch (invalid_argument &ia) {
+        return -1;
+    } catch (out_of_range &oor) {
+        return -1;
+    }
+    if (number < 0) {
+        return -2;
+    }
+    return number;
+}
+
+/*
+Function to convert a string representation of a number
+to type float.
+Params:
+    - numStr: string representation of a number
+Returns:
+    - The number of type float. If the number is invalid or
+    too large, this function will return -1, else if the number is 
+    less then 0, it will return -2.
+*/
+float convert_string_to_float(string numStr) {
+    float number;
+    try {
+        number = stof(numStr);
+    } catch (invalid_argument &ia) {
+        return -1;
+    } catch (out_of_range &oor) {
+        return -1;
+    }
+    if (number < 0) {
+        return -2;
+    }
+    return number;
+}
+
+/*
+This function gets user input from the terminal
+and returns a string of that input.
+Params:
+    - void
+Returns:
+    - A string of the user input.
+*/
+string get_user_input(void) {
+    string userInput;
+    getline(cin, userInput);
+    return userInput;
+}
+
+/*
+Reads a single line from a file. If that file is badly
+formatted or cannot be read, this function will close
+the program.
+Params:
+    - file: pointer to the opened file to read from
+Returns:
+    - A string of the line read.
+*/
+string getLine(ifstream* file) {
+    string line;
+    if (!getline(*file, line)) {
+        cerr << BAD_FORMAT << endl;
+        exit(BAD_FILE_FORMAT);
+    }
+    return line;
+}
+
+/*
+Checks to see if the given string is valid to be 
+used as a holder's name
+Params:
+    - input: string to be checked
+Returns:
+    - bool true if the string is invalid
+    - bool false if the string is valid.
+*/
+bool invalid_string(string input) {
+    return !BankPolicy::Names::valid(input.data(), input.length());
+}
+
+bool is_snapshot(string fileName);
+Bank* load_snapshot(string fileName);
+
+/*
+Loads a bank off a given filename. Snapshots are loaded with
+load_snapshot. If there is an issue with
+the format of the file at any point. The function will cause
+the program to exit.
+Params:
+    - filename: name of the save file of the bank data
+Returns:
+    - A pointer to a bank object that is created within this function
+    and has all the data from the savefile loaded onto it.
+*/
+Bank* load_bank(string fileName) {
+    if (is_snapshot(fileName)) {
+        Bank* bank = load_snapshot(fileName);
+        bank->load_history(fileName);
+        return bank;
+    }
+    ifstream loadFile;
+    loadFile.open(fileName);
+    if (!loadFile) {
+        cerr << BAD_FILE << endl;
+        exit(CANNOT_OPEN_FILE);
+    }
+    string line = getLine(&loadFile);
+    Bank* bank;
+    bank = new Bank(line);
+    line = getLine(&loadFile);
+    int numOfAcc = convert_string_to_int(line);
+    if (numOfAcc == -1 || numOfAcc == -2) {
+        cerr << BAD_FORMAT << endl;
+        exit(BAD_FILE_FORMAT);
+    }
+    for (int i = 0; i < numOfAcc; i++) {
+        line = getLine(&loadFile);
+        if (line.compare(ACCOUNT_SEP_LINE) == 0) {
+            int accNum = convert_string_to_int(getLine(&loadFile));
+            if (accNum == -1 || accNum == -2 || accNum == 0) {
+                cerr << BAD_FORMAT << endl;
+                exit(BAD_FILE_FORMAT);
+            }
+            string holder = getLine(&loadFile);
+            if (invalid_string(holder)) {
+                cerr << BAD_FORMAT << endl;
+                exit(BAD_FILE_FORMAT);
+            }
+            string type = getLine(&loadFile);
+            if (!BankPolicy::Types::valid(type)) {
+                cerr << BAD_FORMAT << endl;
+                exit(BAD_FILE_FORMAT);
+            }
+            float balance = convert_string_to_float(getLine(&loadFile));
+            if (balance == -1 || balance == -2 || balance == 0) {
+                cerr << BAD_FILE << endl;
+                exit(BAD_FILE_FORMAT);
+            }
+            bank->load_account(accNum, holder, type, balance);
+        } else if (line.compare("END") == 0) {
+            cout << "i:" << i << endl;
+            if (i != numOfAcc - 1) {
+                cerr << BAD_FORMAT << endl;
+                exit(BAD_FILE_FORMAT);
+            }
+        }
+    }
+    loadFile.close();
+    bank->load_history(fileName);
+    return bank;
+}
+
+/*
+Creates a bank object based on the whether the bank
+is initialised with a save file or no save file.
+Params:
+    - argc: number of input arguments
+    - argv: for the arguments
+Returns:
+    - A pointer to a bank object created within this funciton.
+*/
+Bank* create_bank(int argc, char** argv) {
+    string bankName;
+    Bank* bank;
+    if (argc == 1) {
+        cout << "Enter the name of the bank: ";
+        getline(cin, bankName);
+        bank = new Bank(bankName);
+        return bank;
+    } else {
+        bank = load_bank(argv[1]);
+        return bank;
+    }
+}
+
+
+/*
+The details of a single account as read from, or written to, a
+savefile or an import/export file.
+*/
+struct AccountRecord {
+    /*Account number.*/
+    int accNum;
+    /*Account holder.*/
+    string holder;
+    /*Account type (S or C).*/
+    string type;
+    /*Account balance.*/
+    Account::Balance balance;
+};
+
+/*
+Checks that a record follows the same rules load_bank applies to a
+savefile: a positive account number, a valid holder name, a type of
+S or C and a positive balance.
+Params:
+    - record: the record to be checked
+Returns:
+    - bool true if the record is valid, false otherwise.
+*/
+bool valid_record(AccountRecord& record) {
+    return record.accNum > 0 &&
+            BankPolicy::Names::valid(record.holder.data(), record.holder.length()) &&
+            BankPolicy::Types::valid(record.type) && record.balance > 0;
+}
+
+/*
+Streaming reader of account records. Records are read one at a
+time so files of any size can be processed in constant memory.
+*/
+class RecordReader {
+    public:
+        /*Public member variable set when the input is incorrectly formatted.*/
+        bool failed;
+        /*Public member variable counting the records read so far.*/
+        long long recordNumber;
+
+        RecordReader(void) {
+            failed = false;
+            recordNumber = 0;
+        }
+
+        virtual ~RecordReader(void) {
+        }
+
+        /*
+        Method to read the next record.
+        Params:
+            - record: set to the record read
+        Returns:
+            - bool true if a record was read, false at the end of the
+            input or if the input is incorrectly formatted (failed is
+            then set).
+        */
+        virtual bool next(AccountRecord* record) = 0;
+};
+
+/*
+Streaming reader of the savefile format written by save.
+*/
+class SavefileReader : public RecordReader {
+    private:
+        /*Private member variable for the savefile being read.*/
+        ifstream file;
+        /*Private member variable for the number of records left to read.*/
+        int remaining;
+
+        /*
+        Method to read a single line of the savefile.
+        Params:
+            - line: set to the line read
+        Returns:
+            - bool true if a line was read, false otherwise.
+        */
+        bool read_line(string& line) {
+            if (!getline(file, line)) {
+                failed = true;
+                return false;
+            }
+            return true;
+        }
+
+    public:
+        /*Public member variable for the name of the bank in the savefile.*/
+        string name;
+        /*Public member variable for the number of accounts in the savefile.*/
+        int numberOfAccounts;
+
+        /*
+        Method to open a savefile and read its header.
+        Params:
+            - fileName: name of the savefile
+        Returns:
+            - bool false if the file could not be opened, true otherwise.
+        */
+        bool open(string fileName) {
+            file.open(fileName);
+            if (!file) {
+                return false;
+            }
+            numberOfAccounts = 0;
+            remaining = 0;
+            string line;
+            if (read_line(name) && read_line(line)) {
+                numberOfAccounts = convert_string_to_int(line);
+                if (numberOfAccounts < 0) {
+                    failed = true;
+                    numberOfAccounts = 0;
+                }
+                remaining = numberOfAccounts;
+            }
+            return true;
+        }
+
+        bool next(AccountRecord* record) {
+            if (failed || remaining == 0) {
+                return false;
+            }
+            string line;
+            if (!read_line(line) || line.compare(ACCOUNT_SEP_LINE) != 0 || !read_line(line)) {
+                failed = true;
+                return false;
+            }
+            record->accNum = convert_string_to_int(line);
+            if (!read_line(record->holder) || !read_line(record->type) || !read_line(line)) {
+                return false;
+            }
+            record->balance = convert_string_to_float(line);
+            if (!valid_record(*record)) {
+                failed = true;
+                return false;
+            }
+            remaining--;
+            recordNumber++;
+            return true;
+        }
+};
+
+/*
+Streaming reader of CSV files with one account per line in the
+order number,holder,type,balance. A header line is optional.
+*/
+class CsvReader : public RecordReader {
+    private:
+        /*Private member variable for the CSV file being read.*/
+        ifstream file;
+        /*Private member variable for the line being split.*/
+        string line;
+
+    public:
+        /*
+        Method to open a CSV file.
+        Params:
+            - fileName: name of the CSV file
+        Returns:
+            - bool false if the file could not be opened, true otherwise.
+        */
+        bool open(string fileName) {
+            file.open(fileName);
+            return (bool) file;
+        }
+
+        bool next(AccountRecord* record) {
+            while (true) {
+                if (failed || !getline(file, line)) {
+                    return false;
+                }
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (!line.empty() && !(recordNumber == 0 && line.compare(CSV_HEADER) == 0)) {
+                    break;
+                }
+            }
+            const char* fields[5];
+            size_t lengths[4];
+            const char* start = line.data();
+            const char* end = start + line.size();
+            int numberOfFields = 0;
+            while (numberOfFields < 4) {
+                const char* comma = (const char*) memchr(start, ',', end - start);
+                fields[numberOfFields] = start;
+                lengths[numberOfFields] = (comma == NULL ? end : comma) - start;
+                numberOfFields++;
+                if (comma == NULL) {
+                    break;
+                }
+                start = comma + 1;
+            }
+            if (numberOfFields != 4 || fields[3] + lengths[3] != end) {
+                failed = true;
+                return false;
+            }
+            record->accNum = convert_string_to_int(string(fields[0], lengths[0]));
+            record->holder.assign(fields[1], lengths[1]);
+            record->type.assign(fields[2], lengths[2]);
+            record->balance = convert_string_to_float(string(fields[3], lengths[3]));
+            if (!valid_record(*record)) {
+                failed = true;
+                return false;
+            }
+            recordNumber++;
+            return true;
+        }
+};
+
+/*
+Calls a function with the key and value of every field of a flat JSON
+object, e.g. {"number": 1001, "holder": "Bob"}. String values are given
+without their quotes; other values as written.
+Params:
+    - object: text of the object
+    - visit: function called with each key and value
+Returns:
+    - bool false if the object is malformed, true otherwise.
+*/
+template <class F>
+bool for_each_json_field(const string& object, F visit) {
+    size_t pos = 1;
+    string key;
+    string value;
+    while (true) {
+        size_t keyStart = object.find('"', pos);
+        if (keyStart == string::npos) {
+            return true;
+        }
+        size_t keyEnd = object.find('"', keyStart + 1);
+        size_t colon = object.find(':', keyEnd);
+        if (keyEnd == string::npos || colon == string::npos) {
+            return false;
+        }
+        key.assign(object, keyStart + 1, keyEnd - keyStart - 1);
+        size_t valueStart = object.find_first_not_of(" \t\r\n", colon + 1);
+        if (valueStart == string::npos) {
+            return false;
+        }
+        if (object[valueStart] == '"') {
+            size_t valueEnd = object.find('"', valueStart + 1);
+            if (valueEnd == string::npos) {
+                return false;
+            }
+            value.assign(object, valueStart + 1, valueEnd - valueStart - 1);
+            pos = valueEnd + 1;
+        } else {
+            size_t valueEnd = object.find_first_of(",} \t\r\n", valueStart);
+            value.assign(object, valueStart, valueEnd - valueStart);
+            pos = valueEnd;
+        }
+        visit(key, value);
+    }
+}
+
+/*
+Streaming reader of JSON files holding an array of account objects
+with the keys number, holder, type and balance. Objects are read one
+at a time, so the array is never held in memory. A file of objects
+without the enclosing array (one per line) is also accepted.
+*/
+class JsonReader : public RecordReader {
+    private:
+        /*Private member variable for the JSON file being read.*/
+        ifstream file;
+        /*Private member variable for the text of the object being parsed.*/
+        string object;
+
+        /*
+        Method to parse the text of one object into a record.
+        Params:
+            - record: set to the parsed record
+        Returns:
+            - bool true if all four keys were found, false otherwise.
+        */
+        bool parse_object(AccountRecord* record) {
+            int keysFound = 0;
+            bool parsed = for_each_json_field(object, [&](const string& key, const string& value) {
+                if (key.compare("number") == 0) {
+                    record->accNum = convert_string_to_int(value);
+                } else if (key.compare("holder") == 0) {
+                    record->holder = value;
+                } else if (key.compare("type") == 0) {
+                    record->type = value;
+                } else if (key.compare("balance") == 0) {
+                    record->balance = convert_string_to_float(value);
+                } else {
+                    return;
+                }
+                keysFound++;
+            });
+            return parsed && keysFound == 4;
+        }
+
+    public:
+        /*
+        Method to open a JSON file.
+        Params:
+            - fileName: name of the JSON file
+        Returns:
+            - bool false if the file could not be opened, true otherwise.
+        */
+        bool open(string fileName) {
+            file.open(fileName);
+            return (bool) file;
+        }
+
+        bool next(AccountRecord* record) {
+            if (failed) {
+                return false;
+            }
+            streambuf* buffer = file.rdbuf();
+            int c = buffer->sbumpc();
+            while (c != EOF && c != '{') {
+                if (c != '[' && c != ']' && c != ',' && !isspace(c)) {
+                    failed = true;
+                    return false;
+                }
+                c = buffer->sbumpc();
+            }
+            if (c == EOF) {
+                return false;
+            }
+            object.assign(1, '{');
+            bool inString = false;
+            while ((c = buffer->sbumpc()) != EOF) {
+                object.push_back(c);
+                if (c == '"') {
+                    inString = !inString;
+                } else if (c == '}' && !inString) {
+                    break;
+                }
+            }
+            if (c == EOF || !parse_object(record) || !valid_record(*record)) {
+                failed = true;
+                return false;
+            }
+            recordNumber++;
+            return true;
+        }
+};
+
+/*
+Appends an unsigned number to a buffer as a varint: seven bits per
+byte, lowest bits first, with the top bit set on all but the last byte.
+Params:
+    - buffer: string to add the varint to
+    - value: the number to add
+Returns:
+    - void
+*/
+void put_varint(string& buffer, unsigned long long value) {
+    while (value >= 0x80) {
+        buffer.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char) value);
+}
+
+/*
+Reads a varint written by put_varint.
+Params:
+    - pos: position to read from, moved past the varint
+    - end: end of the buffer
+    - value: set to the number read
+Returns:
+    - bool true if a varint was read, false if the buffer ended first.
+*/
+bool get_varint(const unsigned char*& pos, const unsigned char* end, unsigned long long* value) {
+    *value = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+        unsigned char byte = *pos++;
+        *value |= (unsigned long long) (byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+Maps a signed number onto an unsigned one so that numbers close to
+zero, positive or negative, give short varints.
+Params:
+    - value: the signed number
+Returns:
+    - The zigzag encoded number.
+*/
+unsigned long long zigzag(long long value) {
+    return ((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63);
+}
+
+/*
+Reverses zigzag.
+Params:
+    - value: the zigzag encoded number
+Returns:
+    - The signed number.
+*/
+long long unzigzag(unsigned long long value) {
+    return (long long) (value >> 1) ^ -(long long) (value & 1);
+}
+
+/*
+Encodes a block of accounts for a snapshot. The block holds, in order:
+the number of accounts; the account numbers as zigzag varint deltas
+from the previous number; the types packed one bit per account (set
+for S); the balances; then the distinct holder
+names, sorted and front coded (varint length of the prefix shared
+with the previous name, varint length of the rest, then the rest),
+followed by each account's varint position in that list. A balance
+that is exactly the nearest Balance to a whole number of cents is
+written as a varint of its zigzag cents shifted left one bit; any other
+balance as a varint 1 followed by a varint of its bits, so every
+balance is read back exactly as it was written.
+Params:
+    - records: the accounts of the block
+Returns:
+    - The encoded block.
+*/
+string encode_snapshot_block(vector<AccountRecord>& records) {
+    string block;
+    put_varint(block, records.size());
+    long long previous = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        put_varint(block, zigzag((long long) records[i].accNum - previous));
+        previous = records[i].accNum;
+    }
+    string types((records.size() + 7) / 8, '\0');
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].type.compare("S") == 0) {
+            types[i / 8] |= 1 << (i % 8);
+        }
+    }
+    block += types;
+    for (size_t i = 0; i < records.size(); i++) {
+        Account::Balance balance = records[i].balance;
+        long long cents = fabs(balance) < SNAPSHOT_CENTS_LIMIT ? llround(balance * 100.0) : 0;
+        if (fabs(balance) < SNAPSHOT_CENTS_LIMIT && (Account::Balance) (cents / 100.0) == balance) {
+            put_varint(block, zigzag(cents) << 1);
+        } else {
+            unsigned long long bits = 0;
+            memcpy(&bits, &balance, sizeof(balance));
+            put_varint(block, 1);
+            put_varint(block, bits);
+        }
+    }
+    vector<string> names;
+    names.reserve(records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+        names.push_back(records[i].holder);
+    }
+    sort(names.begin(), names.end());
+    names.erase(unique(names.begin(), names.end()), names.end());
+    put_varint(block, names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        size_t shared = 0;
+        if (i > 0) {
+            while (shared < names[i].size() && shared < names[i - 1].size() &&
+                    names[i][shared] == names[i - 1][shared]) {
+                shared++;
+            }
+        }
+        put_varint(block, shared);
+        put_varint(block, names[i].size() - shared);
+        block.append(names[i], shared, string::npos);
+    }
+    for (size_t i = 0; i < records.size(); i++) {
+        put_varint(block, lower_bound(names.begin(), names.end(), records[i].holder) - names.begin());
+    }
+    return block;
+}
+
+/*
+Decodes a block written by encode_snapshot_block. Every decoded
+account is checked with the same rules as a savefile.
+Params:
+    - data: start of the block
+    - size: size of the block in bytes
+    - records: set to the accounts of the block
+Returns:
+    - bool true if the block was decoded, false if it is corrupt.
+*/
+bool decode_snapshot_block(const unsigned char* data, size_t size, vector<AccountRecord>* records) {
+    const unsigned char* pos = data;
+    const unsigned char* end = data + size;
+    unsigned long long count, value;
+    if (!get_varint(pos, end, &count) || count > SNAPSHOT_BLOCK_SIZE) {
+        return false;
+    }
+    records->resize(count);
+    long long previous = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!get_varint(pos, end, &value)) {
+            return false;
+        }
+        previous += unzigzag(value);
+        (*records)[i].accNum = previous;
+    }
+    if ((size_t) (end - pos) < (count + 7) / 8) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        (*records)[i].type = (pos[i / 8] >> (i % 8)) & 1 ? "S" : "C";
+    }
+    pos += (count + 7) / 8;
+    for (size_t i = 0; i < count; i++) {
+        if (!get_varint(pos, end, &value)) {
+            return false;
+        }
+        if ((value & 1) == 0) {
+            (*records)[i].balance = unzigzag(value >> 1) / 100.0;
+            continue;
+        }
+        unsigned long long bits;
+        if (value != 1 || !get_varint(pos, end, &bits)) {
+            return false;
+        }
+        memcpy(&(*records)[i].balance, &bits, sizeof((*records)[i].balance));
+    }
+    unsigned long long numberOfNames, shared, rest;
+    if (!get_varint(pos, end, &numberOfNames) || numberOfNames > count) {
+        return false;
+    }
+    vector<string> names(numberOfNames);
+    for (size_t i = 0; i < numberOfNames; i++) {
+        if (!get_varint(pos, end, &shared) || !get_varint(pos, end, &rest) ||
+                (i == 0 ? shared != 0 : shared > names[i - 1].size()) ||
+                rest > (unsigned long long) (end - pos)) {
+            return false;
+        }
+        if (i > 0) {
+            names[i].assign(names[i - 1], 0, shared);
+        }
+        names[i].append((const char*) pos, rest);
+        pos += rest;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!get_varint(pos, end, &value) || value >= numberOfNames) {
+            return false;
+        }
+        (*records)[i].holder = names[value];
+        if (!valid_record((*records)[i])) {
+            return false;
+        }
+    }
+    return pos == end;
+}
+
+/*
+Position and size of one block of a snapshot.
+*/
+struct SnapshotBlock {
+    /*Offset of the block from the start of the file.*/
+    long long offset;
+    /*Size of the block in bytes.*/
+    long long size;
+};
+
+/*
+Checks whether a file is a snapshot, by its first bytes.
+Params:
+    - fileName: name of the file
+Returns:
+    - bool true if the file is a snapshot, false otherwise.
+*/
+bool is_snapshot(string fileName) {
+    ifstream file(fileName, ios::binary);
+    char magic[8];
+    return file.read(magic, sizeof(magic)) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+/*
+Streaming reader of snapshots. A snapshot starts with SNAPSHOT_MAGIC,
+the varint length of the bank's name, the name and the varint number
+of accounts. Blocks of at most SNAPSHOT_BLOCK_SIZE accounts follow,
+then a directory of the blocks' offsets and sizes (varints), and
+finally the 8 byte offset of the directory. Blocks are decoded one
+at a time, so only one block is held in memory.
+*/
+class SnapshotReader : public RecordReader {
+    private:
+        /*Private member variable for the snapshot being read.*/
+        ifstream file;
+        /*Private member variable for the blocks of the snapshot.*/
+        vector<SnapshotBlock> blocks;
+        /*Private member variable for the next block to decode.*/
+        size_t nextBlock;
+        /*Private member variable for the accounts of the current block.*/
+        vector<AccountRecord> current;
+        /*Private member variable for the next account of the current block.*/
+        size_t nextRecord;
+
+    public:
+        /*Public member variable for the name of the bank in the snapshot.*/
+        string name;
+        /*Public member variable for the number of accounts in the snapshot.*/
+        long long numberOfAccounts;
+
+        /*
+        Method to open a snapshot and read its header and directory.
+        Params:
+            - fileName: name of the snapshot
+        Returns:
+            - bool false if the file could not be opened, true otherwise.
+        */
+        bool open(string fileName) {
+            file.open(fileName, ios::binary);
+            if (!file) {
+                return false;
+            }
+            nextBlock = 0;
+            nextRecord = 0;
+            numberOfAccounts = 0;
+            string contents;
+            long long fileSize = filesystem::file_size(fileName);
+            long long directoryOffset = 0;
+            string header(min(fileSize, (long long) 1024), '\0');
+            file.read(&header[0], header.size());
+            if (fileSize >= 16) {
+                file.seekg(fileSize - 8);
+                file.read((char*) &directoryOffset, sizeof(directoryOffset));
+            }
+            if (!file || header.compare(0, 8, SNAPSHOT_MAGIC) != 0 ||
+                    directoryOffset < 8 || directoryOffset > fileSize - 8) {
+                failed = true;
+                return true;
+            }
+            const unsigned char* pos = (const unsigned char*) header.data() + 8;
+            const unsigned char* end = (const unsigned char*) header.data() + header.size();
+            unsigned long long nameLength, count;
+            if (!get_varint(pos, end, &nameLength) || nameLength > (unsigned long long) (end - pos)) {
+                failed = true;
+                return true;
+            }
+            name.assign((const char*) pos, nameLength);
+            pos += nameLength;
+            if (!get_varint(pos, end, &count)) {
+                failed = true;
+                return true;
+            }
+            numberOfAccounts = count;
+            string directory(fileSize - 8 - directoryOffset, '\0');
+            file.seekg(directoryOffset);
+            file.read(&directory[0], directory.size());
+            pos = (const unsigned char*) directory.data();
+            end = pos + directory.size();
+            while (pos < end) {
+                unsigned long long offset, size;
+                if (!get_varint(pos, end, &offset) || !get_varint(pos, end, &size) ||
+                        offset + size > (unsigned long long) directoryOffset) {
+                    failed = true;
+                    return true;
+                }
+                blocks.push_back({(long long) offset, (long long) size});
+            }
+            return true;
+        }
+
+        /*
+        Method to return the blocks of the snapshot.
+        Params:
+            - void
+        Returns:
+            - The position and size of every block.
+        */
+        vector<SnapshotBlock>& get_blocks(void) {
+            return blocks;
+        }
+
+        bool next(AccountRecord* record) {
+            while (!failed && nextRecord == current.size()) {
+                if (nextBlock == blocks.size()) {
+                    return false;
+                }
+                string block(blocks[nextBlock].size, '\0');
+                file.seekg(blocks[nextBlock].offset);
+                file.read(&block[0], block.size());
+                if (!file || !decode_snapshot_block((const unsigned char*) block.data(),
+                        block.size(), &current)) {
+                    failed = true;
+                }
+                nextBlock++;
+                nextRecord = 0;
+            }
+            if (failed) {
+                return false;
+            }
+            *record = current[nextRecord++];
+            recordNumber++;
+            return true;
+        }
+};
+
+/*
+Writes the status of the bank into a snapshot (see SnapshotReader for
+the layout). Accounts are gathered SNAPSHOT_BATCH_BLOCKS blocks at a
+time and the blocks of each batch are encoded in parallel.
+Params:
+    - bank: pointer to the main bank object
+    - fileName: name of the snapshot to write
+Returns:
+    - bool true if the snapshot was written, false if it could not
+    be opened.
+*/
+bool save_snapshot(Bank* bank, string fileName) {
+    ofstream snapshotFile(fileName, ios::binary);
+    if (!snapshotFile) {
+        return false;
+    }
+    string header = SNAPSHOT_MAGIC;
+    put_varint(header, bank->name.size());
+    header += bank->name;
+    put_varint(header, bank->get_num_of_accounts());
+    snapshotFile << header;
+    long long offset = header.size();
+    string directory;
+    vector<vector<AccountRecord>> batch(1);
+    function<void()> write_batch = [&]() {
+        vector<string> encoded(batch.size());
+        parallel_for_chunks(batch.size(), 1, [&](size_t begin, size_t) {
+            encoded[begin] = encode_snapshot_block(batch[begin]);
+        });
+        for (size_t i = 0; i < encoded.size(); i++) {
+            put_varint(directory, offset);
+            put_varint(directory, encoded[i].size());
+            snapshotFile << encoded[i];
+            offset += encoded[i].size();
+        }
+        batch.assign(1, vector<AccountRecord>());
+    };
+    bank->for_each_account([&](Account& account) {
+        if (batch.back().size() == SNAPSHOT_BLOCK_SIZE) {
+            if (batch.size() == SNAPSHOT_BATCH_BLOCKS) {
+                write_batch();
+            } else {
+                batch.push_back(vector<AccountRecord>());
+            }
+        }
+        batch.back().push_back({account.get_acc_num(), account.get_holder(),
+                account.get_type(), account.get_balance()});
+    });
+    if (!batch.back().empty()) {
+        write_batch();
+    }
+    snapshotFile << directory;
+    snapshotFile.write((char*) &offset, sizeof(offset));
+    snapshotFile.close();
+    return !snapshotFile.fail();
+}
+
+/*
+Loads a bank off a snapshot. The whole snapshot is read in one go and
+its blocks are decoded in parallel before the accounts are added to
+the bank. If the snapshot is corrupt the function will cause the
+program to exit.
+Params:
+    - fileName: name of the snapshot
+Returns:
+    - A pointer to a bank object created within this function.
+*/
+Bank* load_snapshot(string fileName) {
+    SnapshotReader reader;
+    if (!reader.open(fileName)) {
+        cerr << BAD_FILE << endl;
+        exit(CANNOT_OPEN_FILE);
+    }
+    vector<SnapshotBlock>& blocks = reader.get_blocks();
+    string contents(filesystem::file_size(fileName), '\0');
+    ifstream file(fileName, ios::binary);
+    file.read(&contents[0], contents.size());
+    vector<vector<AccountRecord>> decoded(blocks.size());
+    atomic<bool> corrupt(reader.failed || !file);
+    parallel_for_chunks(blocks.size(), 1, [&](size_t begin, size_t) {
+        if (!decode_snapshot_block((const unsigned char*) contents.data() + blocks[begin].offset,
+                blocks[begin].size, &decoded[begin])) {
+            corrupt = true;
+        }
+    });
+    if (corrupt) {
+        cerr << BAD_FORMAT << endl;
+        exit(BAD_FILE_FORMAT);
+    }
+    Bank* bank = new Bank(reader.name);
+    bank->reserve(reader.numberOfAccounts);
+    for (size_t i = 0; i < decoded.size(); i++) {
+        for (size_t j = 0; j < decoded[i].size(); j++) {
+            AccountRecord& record = decoded[i][j];
+            try {
+                bank->load_account(record.accNum, record.holder, record.type, record.balance);
+            } catch (AccountAlreadyExistsException &e) {
+                cerr << BAD_FORMAT << endl;
+                exit(BAD_FILE_FORMAT);
+            }
+        }
+        vector<AccountRecord>().swap(decoded[i]);
+    }
+    if (bank->get_num_of_accounts() != reader.numberOfAccounts) {
+        cerr << BAD_FORMAT << endl;
+        exit(BAD_FILE_FORMAT);
+    }
+    return bank;
+}
+
+/*
+Function to return the extension of a file name.
+Params:
+    - fileName: name of the file
+Returns:
+    - The extension including the dot, or an empty string.
+*/
+string file_extension(string fileName) {
+    return filesystem::path(fileName).extension().string();
+}
+
+/*
+Function to identify the current contents of a file by its size and
+modification time, which change whenever the file is replaced.
+Params:
+    - fileName: name of the file
+Returns:
+    - The size and modification time, or an empty string if the file
+    does not exist.
+*/
+string file_stamp(string fileName) {
+    error_code error;
+    uintmax_t size = filesystem::file_size(fileName, error);
+    if (error) {
+        return "";
+    }
+    long long modified = filesystem::last_write_time(fileName, error).time_since_epoch().count();
+    return to_string(size) + " " + to_string(modified);
+}
+
+/*
+Opens a streaming reader for a file, chosen by the file's extension:
+.csv and .json files are read as CSV and JSON, snapshots (recognised
+by their first bytes) as snapshots, and anything else as a savefile.
+Params:
+    - fileName: name of the file to read
+Returns:
+    - Pointer to the reader, or null if the file could not be opened.
+*/
+RecordReader* open_record_reader(string fileName) {
+    string extension = file_extension(fileName);
+    if (extension.compare(".csv") == 0) {
+        CsvReader* reader = new CsvReader();
+        if (reader->open(fileName)) {
+            return reader;
+        }
+        delete reader;
+    } else if (extension.compare(".json") == 0) {
+        JsonReader* reader = new JsonReader();
+        if (reader->open(fileName)) {
+            return reader;
+        }
+        delete reader;
+    } else if (is_snapshot(fileName)) {
+        SnapshotReader* reader = new SnapshotReader();
+        if (reader->open(fileName)) {
+            return reader;
+        }
+        delete reader;
+    } else {
+        SavefileReader* reader = new SavefileReader();
+        if (reader->open(fileName)) {
+            return reader;
+        }
+        delete reader;
+    }
+    return NULL;
+}
+
+/*
+Streaming writer of account records to a CSV or JSON file. Output
+is collected in a buffer and written out in large blocks.
+*/
+class RecordWriter {
+    private:
+        /*Private member variable for the file being written.*/
+        ofstream file;
+        /*Private member variable for output not yet written to the file.*/
+        string buffer;
+        /*Private member variable set when writing JSON rather than CSV.*/
+        bool json;
+        /*Private member variable counting the records written so far.*/
+        long long numberOfRecords;
+
+        /*
+        Method to write out the buffer once it is large enough.
+        Params:
+            - force: write out the buffer whatever its size
+        Returns:
+            - void
+        */
+        void flush(bool force) {
+            if (force || buffer.size() >= (1 << 20)) {
+                file.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+
+    public:
+        /*
+        Method to open the output file. The format is chosen by the
+        file's extension, which must be .csv or .json.
+        Params:
+            - fileName: name of the file to write
+        Returns:
+            - bool false if the extension is not recognised or the file
+            could not be opened, true otherwise.
+        */
+        bool open(string fileName) {
+            string extension = file_extension(fileName);
+            if (extension.compare(".csv") != 0 && extension.compare(".json") != 0) {
+                return false;
+            }
+            json = extension.compare(".json") == 0;
+            numberOfRecords = 0;
+            file.open(fileName);
+            buffer = json ? "[" : CSV_HEADER "\n";
+            return (bool) file;
+        }
+
+        /*
+        Method to write a single record.
+        Params:
+            - record: the record to write
+        Returns:
+            - void
+        */
+        void write(AccountRecord& record) {
+            if (json) {
+                buffer += numberOfRecords == 0 ? "\n" : ",\n";
+                buffer += "{\"number\": " + to_string(record.accNum) +
+                        ", \"holder\": \"" + record.holder +
+                        "\", \"type\": \"" + record.type +
+                        "\", \"balance\": " + to_string(record.balance) + "}";
+            } else {
+                buffer += to_string(record.accNum) + ',' + record.holder + ',' +
+                        record.type + ',' + to_string(record.balance) + '\n';
+            }
+            numberOfRecords++;
+            flush(false);
+        }
+
+        /*
+        Method to finish the file and write out anything buffered.
+        Params:
+            - void
+        Returns:
+            - bool true if everything was written, false otherwise.
+        */
+        bool finish(void) {
+            if (json) {
+                buffer += "\n]\n";
+            }
+            flush(true);
+            file.close();
+            return !file.fail();
+        }
+};
+
+/*
+A single entry of a savefile index: the byte offset within the
+savefile of an account's record.
+*/
+struct IndexEntry {
+    /*Account number.*/
+    int accNum;
+    /*Unused, keeps the offsets aligned.*/
+    int reserved;
+    /*Offset of the line holding the account number.*/
+    long long offset;
+};
+
+/*
+Header at the start of a savefile index. The size and modification
+time of the savefile are kept so an index left over from an older
+savefile is not used.
+*/
+struct IndexHeader {
+    /*Always INDEX_MAGIC.*/
+    char magic[8];
+    /*Size in bytes of the savefile the index was built for.*/
+    long long savefileSize;
+    /*Modification time of the savefile the index was built for.*/
+    long long savefileModified;
+    /*Number of entries following the header.*/
+    long long numberOfEntries;
+};
+
+/*
+Writes the index of a savefile to its sidecar file (the savefile's
+name followed by INDEX_SUFFIX). The entries are sorted by account
+number so the index can be searched without being loaded.
+Params:
+    - fileName: name of the savefile
+    - entries: offsets of every account in the savefile
+Returns:
+    - bool true if the index was written, false otherwise.
+*/
+bool write_savefile_index(string fileName, vector<IndexEntry>& entries) {
+    sort(entries.begin(), entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+        return a.accNum < b.accNum;
+    });
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.savefileSize = filesystem::file_size(fileName);
+    header.savefileModified = filesystem::last_write_time(fileName).time_since_epoch().count();
+    header.numberOfEntries = entries.size();
+    ofstream indexFile(fileName + INDEX_SUFFIX, ios::binary);
+    indexFile.write((char*) &header, sizeof(header));
+    indexFile.write((char*) entries.data(), entries.size() * sizeof(IndexEntry));
+    return (bool) indexFile;
+}
+
+/*
+Builds the index of a savefile by reading through it once.
+Params:
+    - fileName: name of the savefile
+Returns:
+    - bool true if the index was built, false if the savefile is
+    incorrectly formatted.
+*/
+bool build_savefile_index(string fileName) {
+    ifstream saveFile(fileName);
+    vector<IndexEntry> entries;
+    string line;
+    long long offset = 0;
+    int lineNumber = 0;
+    while (getline(saveFile, line)) {
+        if (lineNumber >= 2 && line.compare(ACCOUNT_SEP_LINE) == 0) {
+            IndexEntry entry;
+            entry.offset = offset + line.size() + 1;
+            entry.reserved = 0;
+            if (!getline(saveFile, line)) {
+                return false;
+            }
+            entry.accNum = convert_string_to_int(line);
+            entries.push_back(entry);
+        }
+        offset = saveFile.tellg();
+        lineNumber++;
+    }
+    return write_savefile_index(fileName, entries);
+}
+
+/*
+The savefile behind a lazily opened bank. Keeps the savefile's index
+mapped into memory, and tracks which of the savefile's accounts have
+since been changed, added or deleted, so that the savefile itself
+never needs to be loaded in full.
+*/
+class LazySource {
+    private:
+        /*Private member variable for the mapped index file.*/
+        void* mapping;
+        /*Private member variable for the size of the mapping.*/
+        size_t mappingSize;
+        /*Private member variable for the sorted index entries.*/
+        IndexEntry* entries;
+        /*Private member variable for the number of index entries.*/
+        long long numberOfEntries;
+        /*Private member variable for reading records out of the savefile.*/
+        ifstream file;
+
+    public:
+        /*Public member variable for the name of the savefile.*/
+        string fileName;
+        /*Public member variable for the savefile's accounts that have been deleted.*/
+        unordered_set<int> deleted;
+        /*Public member variable for the savefile's accounts that have been changed.*/
+        unordered_set<int> changed;
+        /*Public member variable for accounts not in the savefile.*/
+        unordered_set<int> added;
+        /*Public member variable for the order accounts were read in, oldest first.*/
+        deque<int> faultOrder;
+
+        LazySource(void) {
+            mapping = MAP_FAILED;
+            mappingSize = 0;
+            entries = NULL;
+            numberOfEntries = 0;
+        }
+
+        ~LazySource(void) {
+            if (mapping != MAP_FAILED) {
+                munmap(mapping, mappingSize);
+            }
+        }
+
+        /*
+        Method to open a savefile and map its index, building the
+        index first if it is missing or out of date.
+        Params:
+            - fileName: name of the savefile
+        Returns:
+            - bool true if the savefile and its index were opened,
+            false otherwise.
+        */
+        bool open(string fileName) {
+            this->fileName = fileName;
+            file.open(fileName);
+            if (!file) {
+                return false;
+            }
+            for (int attempt = 0; attempt < 2; attempt++) {
+                int descriptor = ::open((fileName + INDEX_SUFFIX).c_str(), O_RDONLY);
+                struct stat info;
+                if (descriptor >= 0 && fstat(descriptor, &info) == 0 &&
+                        info.st_size >= (off_t) sizeof(IndexHeader)) {
+                    mappingSize = info.st_size;
+                    mapping = mmap(NULL, mappingSize, PROT_READ, MAP_SHARED, descriptor, 0);
+                }
+                if (descriptor >= 0) {
+                    close(descriptor);
+                }
+                if (mapping != MAP_FAILED) {
+                    IndexHeader* header = (IndexHeader*) mapping;
+                    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                            header->savefileSize == (long long) filesystem::file_size(fileName) &&
+                            header->savefileModified ==
+                                    filesystem::last_write_time(fileName).time_since_epoch().count() &&
+                            mappingSize == sizeof(IndexHeader) +
+                                    header->numberOfEntries * sizeof(IndexEntry)) {
+                        entries = (IndexEntry*) (header + 1);
+                        numberOfEntries = header->numberOfEntries;
+                        return true;
+                    }
+                    munmap(mapping, mappingSize);
+                    mapping = MAP_FAILED;
+                }
+                if (attempt == 0 && !build_savefile_index(fileName)) {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        /*
+        Method to find an account's record in the savefile.
+        Params:
+            - number: account number
+            - offset: set to the offset of the account's record
+        Returns:
+            - bool true if the savefile holds the account, false otherwise.
+        */
+        bool find(int number, long long* offset) {
+            IndexEntry* end = entries + numberOfEntries;
+            IndexEntry* found = lower_bound(entries, end, number,
+                    [](const IndexEntry& entry, int key) { return entry.accNum < key; });
+            if (found == end || found->accNum != number) {
+                return false;
+            }
+            *offset = found->offset;
+            return true;
+        }
+
+        /*
+        Method to read an account's record out of the savefile. The
+        record must be the account's, so an index that does not match
+        its savefile never hands out the wrong account.
+        Params:
+            - number: account number
+            - offset: offset of the account's record
+            - record: set to the record read
+        Returns:
+            - bool true if a valid record of the account was read,
+            false otherwise.
+        */
+        bool read(int number, long long offset, AccountRecord* record) {
+            string line;
+            file.clear();
+            file.seekg(offset);
+            if (!getline(file, line)) {
+                return false;
+            }
+            record->accNum = convert_string_to_int(line);
+            if (!getline(file, record->holder) || !getline(file, record->type) ||
+                    !getline(file, line)) {
+                return false;
+            }
+            record->balance = convert_string_to_float(line);
+            return record->accNum == number && valid_record(*record);
+        }
+
+        /*
+        Method to check whether an account number belongs to an
+        account still held in the savefile.
+        Params:
+            - number: account number
+        Returns:
+            - bool true if the savefile holds the account and it has
+            not been deleted, false otherwise.
+        */
+        bool holds(int number) {
+            long long offset;
+            return deleted.count(number) == 0 && find(number, &offset);
+        }
+};
+
+template <class Policy>
+BasicBank<Policy>::~BasicBank(void) {
+    delete source;
+}
+
+/*
+Method to check whether the bank was opened lazily and still reads
+accounts from its savefile.
+Params:
+    - void
+Returns:
+    - bool true if the bank is lazy, false otherwise.
+*/
+template <class Policy>
+bool BasicBank<Policy>::is_lazy(void) {
+    return source != NULL;
+}
+
+/*
+Method to make the bank read its accounts from a savefile on demand.
+Accounts already held by the bank are treated as the savefile's own.
+Params:
+    - fileName: name of the savefile
+    - numberOfFileAccounts: number of accounts in the savefile
+Returns:
+    - void
+Throws:
+    - runtime_error if the savefile or its index cannot be opened.
+*/
+template <class Policy>
+void BasicBank<Policy>::open_source(string fileName, int numberOfFileAccounts) {
+    LazySource* opened = new LazySource();
+    if (!opened->open(fileName)) {
+        delete opened;
+        throw runtime_error(BAD_FILE);
+    }
+    delete source;
+    source = opened;
+    numberOfAccounts = numberOfFileAccounts;
+    for (int i = 0; i < (int) accounts.size(); i++) {
+        source->faultOrder.push_back(accounts.at(i).get_acc_num());
+    }
+}
+
+/*
+Method to read an account from the savefile of a lazy bank and keep
+it in memory. Once more than LAZY_CACHE_SIZE accounts have been read,
+the oldest unchanged ones are dropped again.
+Params:
+    - number: account number
+Returns:
+    - Pointer to the account, or null if the account does not exist.
+*/
+template <class Policy>
+typename BasicBank<Policy>::Account* BasicBank<Policy>::fault_in(int number) {
+    long long offset;
+    AccountRecord record;
+    if (source == NULL || source->deleted.count(number) != 0 ||
+            !source->find(number, &offset) || !source->read(number, offset, &record)) {
+        return NULL;
+    }
+    while (source->faultOrder.size() >= LAZY_CACHE_SIZE) {
+        int oldest = source->faultOrder.front();
+        source->faultOrder.pop_front();
+        AccountIndex::iterator slot = slots.find(oldest);
+        if (slot == slots.end() || source->changed.count(oldest) != 0 ||
+                source->added.count(oldest) != 0) {
+            continue;
+        }
+        int i = slot->second;
+        slots.erase(slot);
+        if (i != (int) accounts.size() - 1) {
+            accounts.at(i) = accounts.back();
+            slots[accounts.at(i).get_acc_num()] = i;
+        }
+        accounts.pop_back();
+    }
+    slots[number] = accounts.size();
+    accounts.push_back(Account(record.accNum, record.holder, record.type, record.balance));
+    source->faultOrder.push_back(number);
+    return &accounts.back();
+}
+
+/*
+Method to check whether an account not in memory is still held in
+the savefile of a lazy bank.
+Params:
+    - number: account number
+Returns:
+    - bool true if the savefile holds the account, false otherwise.
+*/
+template <class Policy>
+bool BasicBank<Policy>::in_source(int number) {
+    return source != NULL && slots.count(number) == 0 && source->holds(number);
+}
+
+/*
+Method to note that an account not in the savefile has been added
+to a lazy bank.
+Params:
+    - number: account number
+Returns:
+    - void
+*/
+template <class Policy>
+void BasicBank<Policy>::source_added(int number) {
+    if (source != NULL) {
+        source->added.insert(number);
+    }
+}
+
+/*
+Method to note that an account has been removed from a lazy bank,
+either by being deleted or by being given a new account number.
+Params:
+    - number: account number
+Returns:
+    - void
+*/
+template <class Policy>
+void BasicBank<Policy>::source_removed(int number) {
+    if (source == NULL) {
+        return;
+    }
+    if (source->added.erase(number) == 0) {
+        source->deleted.insert(number);
+        source->changed.erase(number);
+    }
+}
+
+/*
+Method to note that an account of a lazy bank has been changed, so
+it is kept in memory until the bank is saved.
+Params:
+    - number: account number
+Returns:
+    - void
+*/
+template <class Policy>
+void BasicBank<Policy>::source_changed(int number) {
+    if (source != NULL) {
+        source->changed.insert(number);
+    }
+}
+
+/*
+Method to visit every account of the bank. For a lazy bank the
+savefile is read through in order, using the in-memory copy of any
+account that has been read, followed by the accounts added since.
+Params:
+    - visit: function called with every account
+Returns:
+    - void
+*/
+template <class Policy>
+void BasicBank<Policy>::for_each_account(function<void(Account&)> visit) {
+    typename Policy::Lock::Guard guard(lock);
+    if (source == NULL) {
+        for (int i = 0; i < (int) accounts.size(); i++) {
+            visit(accounts.at(i));
+        }
+        return;
+    }
+    SavefileReader reader;
+    reader.open(source->fileName);
+    AccountRecord record;
+    while (reader.next(&record)) {
+        if (source->deleted.count(record.accNum) != 0) {
+            continue;
+        }
+        AccountIndex::iterator slot = slots.find(record.accNum);
+        if (slot != slots.end()) {
+            visit(accounts.at(slot->second));
+        } else {
+            Account account(record.accNum, record.holder, record.type, record.balance);
+            visit(account);
+        }
+    }
+    for (int number : source->added) {
+        visit(accounts.at(slots[number]));
+    }
+}
+
+/*
+Method to read every remaining account of a lazy bank into memory,
+after which the bank no longer uses its savefile. Does nothing for
+a bank that is not lazy. The mutation log starts from this point,
+with the accounts read as its first checkpoint.
+Params:
+    - void
+Returns:
+    - void
+*/
+template <class Policy>
+void BasicBank<Policy>::load_all(void) {
+    typename Policy::Lock::Guard guard(lock);
+    if (source == NULL) {
+        return;
+    }
+    vector<Account> all;
+    all.reserve(numberOfAccounts);
+    for_each_account([&all](Account& account) {
+        all.push_back(account);
+    });
+    delete source;
+    source = NULL;
+    accounts.swap(all);
+    slots.clear();
+    slots.reserve(accounts.size());
+    for (int i = 0; i < (int) accounts.size(); i++) {
+        slots[accounts.at(i).get_acc_num()] = i;
+    }
+    numberOfAccounts = accounts.size();
+    mutationLog.begin(accounts);
+}
+
+/*
+Opens a bank lazily off a given savefile. Only the savefile's header
+is read; accounts are read on demand through the savefile's index,
+which is built the first time the savefile is opened this way. A
+snapshot has no such index, so it is loaded in full with load_bank.
+If the savefile cannot be opened or is incorrectly formatted the
+function will cause the program to exit.
+Params:
+    - fileName: name of the savefile of the bank data
+Returns:
+    - A pointer to a bank object created within this function.
+*/
+Bank* open_lazy_bank(string fileName) {
+    if (is_snapshot(fileName)) {
+        return load_bank(fileName);
+    }
+    SavefileReader reader;
+    if (!reader.open(fileName)) {
+        cerr << BAD_FILE << endl;
+        exit(CANNOT_OPEN_FILE);
+    }
+    if (reader.failed) {
+        cerr << BAD_FORMAT << endl;
+        exit(BAD_FILE_FORMAT);
+    }
+    Bank* bank = new Bank(reader.name);
+    try {
+        bank->open_source(fileName, reader.numberOfAccounts);
+    } catch (runtime_error &e) {
+        cerr << BAD_FORMAT << endl;
+        exit(BAD_FILE_FORMAT);
+    }
+    bank->load_history(fileName);
+    return bank;
+}
+
+/*
+Functino to querry the user until they have put in the correct
+input for a number. The generic T is used for ints and floats.
+Params:
+    - message: message to display when querrying the user
+    - function pointer: represents a function that takes in a
+    string and returns a type T. Used for functions
+    convert_string_to_int and convert_string_to_float.
+Returns:
+    - Number type (float or int) of the input given by the user.
+*/
+template <typename T>
+T run_question_sequence(string message, T (*foo)(string)) {
+    T num;
+    while (true) {
+        cout << message;
+        string userInputStr = get_user_input();
+        num = foo(userInputStr);
+        if (num == -1) {
+            cout << "Please enter a valid number.\n";
+            continue;
+        } else if (num == 0) {
+            cout << "Please enter a non-zero account number.\n";
+            continue;
+        } else if (num == -2) {
+            cout << "Please enter a non-negative account number.\n";
+            continue;
+        }
+        break;
+    }
+    return num;
+}
+
+/*
+Querries the user for the account number of the new account
+Params:
+    - Pointer to the bank object
+Returns:
+    - The int representation of the number given by the user
+*/
+int get_account_number(Bank*) {
+    int accNum = run_question_sequence("Enter the account number: ", 
+            convert_string_to_int);
+    return accNum;
+
+}
+
+/*
+Querries the user for the holder of the new account
+Params:
+    - message: message to querry the user
+Returns:
+    - String of the account holder.
+*/
+string get_account_holder(string message) {
+    string accHolder;
+    while (true) {
+        cout << message;
+        accHolder = get_user_input();
+        if (invalid_string(accHolder)) {
+            cout << 
+            "Please enter a holder name containing the characters between A-Z and a-z\n";
+            continue;
+        }
+        break;
+    }
+    return accHolder;
+}
+
+/*
+Querries the user for the type of the new account
+Params:
+    - message: message to display to the user when
+    querrying them.
+Returns:
+    - String of the type of the account.
+*/
+string get_type_of_account(string message) {
+    string accType;
+    while (true) {
+        cout << message;
+        accType = get_user_input();
+        if (!BankPolicy::Types::valid(accType)) {
+            cout << "Please enter S for savings or C for current account\n";
+            continue;
+        }
+        break;   
+    }
+    return accType;
+}
+
+/*
+Querries the user for the balance of the new account
+Params:
+    - message: message to display to the user when
+    querrying them.
+Returns:
+    - Balance of the account in type float.
+*/
+float get_balance(string message) {
+    float amount = run_question_sequence(message, 
+            convert_string_to_float);
+    return amount;
+}
+
+/*
+Function that forces the user to press enter to see
+the status of the action just completed before
+entering back to the main screen.
+Params:
+    - message: message to display to the user at
+    the end of an action (i.e. account withdrawal,
+    deposit, etc.)
+Returns:
+    - void
+*/
+void end_action(string message) {
+    cout << message;
+    cout << "Press enter to continue.\n";
+    fgetc(stdin);
+    cout << string(31, '-') << endl;
+}
+
+/*
+Performs an account transaction for either a deposit
+or a withdrawl.
+Params:
+    - bank: pointer to the main bank object
+    - withdraw: flag to indicate whehter the account
+    transaction is a deposit or withdraw. True if
+    the transaction is a withdraw, false otherwise.
+Returns:
+    - void
+*/
+void account_transaction_form(Bank* bank, bool withdraw) {
+    cout << "----Account Transaction Form----\n";
+    int accNum = run_question_sequence("Enter the account number: ", 
+            convert_string_to_int);
+    bank->get_account(accNum)->display_account();
+    float amount;
+    if (!withdraw) {
+        amount = run_question_sequence("Enter the amount to deposit: ", 
+                convert_string_to_float);
+        bank->deposit(accNum, amount);
+    } else {
+        while (true) {
+            amount = run_question_sequence("Enter the amount to withdraw: ", 
+                        convert_string_to_float);
+            try {
+                bank->withdraw(accNum, amount);
+                break;
+            } catch (NegativeBalanceException &nb) {
+                cout << "Insufficient funds.\n";
+            }
+        }
+    }
+}
+
+/*
+Given a string (buffer) adds the account number to this string
+Params:
+    - buffer: string to add the account number to.
+    - account: the account which the account number comes from
+Returns:
+    - The buffer string with the concatenated account number.
+*/
+string add_account_num(string buffer, Account* account) {
+    int accNum = account->get_acc_num();
+    string accNumStr = to_string(accNum);
+    buffer = buffer + accNumStr;
+    buffer = buffer + string(NAME_POS - accNumStr.size(), ' ');
+    return buffer;
+}
+
+/*
+Given a string (buffer) adds the account holder to this string
+Params:
+    - buffer: string to add the account holder to.
+    - account: the account which the account holder comes from
+Returns:
+    - The buffer string with the concatenated account holder.
+*/
+string add_holder(string buffer, Account* account) {
+    string holder = account->get_holder();
+    buffer = buffer + holder;
+    buffer = buffer + string(TYPE_POS - buffer.size(), ' ');
+    return buffer;
+}
+
+/*
+Given a string (buffer) adds the account type to this string
+Params:
+    - buffer: string to add the account type to.
+    - account: the account which the account type comes from
+Returns:
+    - The buffer string with the concatenated account type.
+*/
+string add_type(string buffer, Account* account) {
+    string type = account->get_type();
+    buffer = buffer + type;
+    buffer = buffer + string(BALANCE_POS - buffer.size(), ' ');
+    return buffer;
+}
+
+/*
+Given a string (buffer) adds the account balance to this string
+Params:
+    - buffer: string to add the account balance to.
+    - account: the account which the account balance comes from
+Returns:
+    - The buffer string with the concatenated account balance.
+*/
+string add_balance(string buffer, Account* account) {
+    float balance = account->get_balance();
+    string balanceStr = to_string(balance);
+    buffer = buffer + balanceStr;
+    return buffer;
+}
+
+/*
+Adds the details of the account to the string buffer.
+Params:
+    - buffer: string to add the account details to
+    - account: account in which the details are to
+    be added from
+Returns:
+    - The buffer string with the account details concatenated
+    onto the end of it.
+*/
+string add_details_to_string(string buffer, Account* account) {
+    buffer = add_account_num(buffer, account);
+    buffer = add_holder(buffer, account);
+    buffer = add_type(buffer, account);
+    buffer = add_balance(buffer , account);
+    return buffer;
+}
+
+/*
+Determines whether or not the new account number from the user
+is unique and is not already in use.
+Params:
+    - accNum: number requested for the new account
+    - bank: pointer to the main bank object
+Returns:
+    - True if the requested account number is already in use
+    - False otherwise.
+*/
+bool not_unique(Bank* bank, int accNum) {
+    try {
+        bank->get_account(accNum);
+    } catch (AccountNotFoundException &e) {
+        return false;
+    }
+    return true;
+}
+
+/*
+Creates a new account for the banking system. Will request user
+input regarding the account details.
+Params:
+    - bank: pointer to the main bank object
+    - message: initial message to display to the terminal.
+Returns:
+    - void
+*/
+void new_account(Bank* bank, string message) {
+    cout << message;
+    int accountNumber;
+    string accountHolder, accType;
+    float amount;
+    accountNumber = get_account_number(bank);
+    if (not_unique(bank, accountNumber)) {
+        end_action("An account with the account number " + to_string(accountNumber) + " already exists\n");
+        return;
+    }
+    accountHolder = get_account_holder("Enter the name of the account holder: ");
+    accType = get_type_of_account("Enter the type of the account (type 'S' for savings or 'C' for current): ");
+    amount = get_balance("Enter initial amount: ");
+    bank->add_account(accountNumber, accountHolder, accType, amount);
+    end_action("Account was set up succesfully\n");
+}
+
+/*
+Performs a deposit into the requested bank account. Will
+querry the user to get the account details, and the amount
+to deposit. If no account is found, no operation is performed.
+Params:
+    - bank: pointer to the main bank object.
+Returns:
+    - void.
+*/
+void deposit(Bank* bank) {
+    try {
+        account_transaction_form(bank, false);
+        end_action("Record Updated.\n");
+    } catch (AccountNotFoundException &e) {
+        end_action("Could not find the requested account.\n");
+    }
+}
+
+/*
+Performs a withdraw into the requested bank account. Will
+querry the user to get the account details, and the amount
+to deposit. If no account is found, no operation is performed.
+Params:
+    - bank: pointer to the main bank object.
+Returns:
+    - void.
+*/
+void withdraw(Bank* bank) {
+    try {
+        account_transaction_form(bank, true);
+        end_action("Record updated.\n");
+    } catch (AccountNotFoundException &e) {
+        end_action("Could not find the account requested\n");
+    }
+}
+
+/*
+Performs the balance enquiry operation for the banking system.
+Displays all information of the requested account to the terminal.
+If no account is found, no operation is performed.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void balance_enquiry(Bank* bank) {
+    cout << "Balance Details.\n";
+    int accNum = run_question_sequence("Enter the account number: ", 
+            convert_string_to_int);
+    try {
+        bank->get_account(accNum)->display_account();
+    } catch (AccountNotFoundException &e) {
+        end_action("The account " + to_string(accNum) + " does not exist\n");
+        return;
+    }
+    end_action("");
+}
+
+/*
+Querries the user for the order to list accounts in.
+Params:
+    - void
+Returns:
+    - One of SORT_BY_INSERTION, SORT_BY_NUMBER, SORT_BY_NAME or
+    SORT_BY_BALANCE.
+*/
+int get_sort_order(void) {
+    cout << "----All Account Holders List----\n";
+    cout << "Sort by 1. Insertion Order 2. Account Number 3. Name 4. Balance (default 1): ";
+    int sortBy = convert_string_to_int(get_user_input());
+    if (sortBy < SORT_BY_INSERTION || sortBy > SORT_BY_BALANCE) {
+        sortBy = SORT_BY_INSERTION;
+    }
+    return sortBy;
+}
+
+/*
+Displays the account information of all accounts to the terminal.
+Params:
+    - bank: pointer to the main bank object
+    - sortBy: order to list the accounts in
+Returns:
+    - void
+*/
+void list_account_holders(Bank* bank, int sortBy) {
+    string banner = string(101, '=') + '\n';
+    cout << banner;
+    string header = "Acc. No" + string(25, ' ') + 
+            "Name" + string(25, ' ') + "Type" + string(25, ' ') + "Balance\n";
+    cout << header;
+    cout << banner;
+    if (sortBy == SORT_BY_INSERTION) {
+        bank->for_each_account([](Account& account) {
+            cout << add_details_to_string("", &account) << '\n';
+        });
+        return;
+    }
+    vector<int> positions = bank->sorted_positions(sortBy);
+    for (size_t i = 0; i < positions.size(); i++) {
+        cout << add_details_to_string("", bank->get_account_at(positions[i])) << '\n';
+    }
+}
+
+/*
+Displays the account information of all accounts to the terminal,
+in the order the user chooses.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void account_holders(Bank* bank) {
+    list_account_holders(bank, get_sort_order());
+}
+
+/*
+Displays the most recent deposits and withdrawals made on the
+requested account. If no account is found, no operation is performed.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void account_statement(Bank* bank) {
+    cout << "----Account Statement----\n";
+    int accNum = run_question_sequence("Enter the account number: ", 
+            convert_string_to_int);
+    try {
+        bank->get_account(accNum)->display_account();
+    } catch (AccountNotFoundException &e) {
+        end_action("The account " + to_string(accNum) + " does not exist\n");
+        return;
+    }
+    string banner = string(101, '=') + '\n';
+    cout << banner;
+    cout << "Date" + string(29, ' ') + "Type" + string(25, ' ') + 
+            "Amount" + string(23, ' ') + "Balance\n";
+    cout << banner;
+    vector<Transaction> entries = bank->statement(accNum, STATEMENT_LENGTH);
+    for (size_t i = 0; i < entries.size(); i++) {
+        Transaction entry = entries.at(i);
+        time_t seconds = entry.timestamp / 1000000;
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+        string buffer = date;
+        buffer = buffer + string(NAME_POS - buffer.size(), ' ');
+        switch (entry.kind) {
+            case TXN_DEPOSIT: buffer = buffer + "Deposit"; break;
+            case TXN_WITHDRAW: buffer = buffer + "Withdraw"; break;
+            case TXN_INTEREST: buffer = buffer + "Interest"; break;
+            case TXN_FEE: buffer = buffer + "Fee"; break;
+        }
+        buffer = buffer + string(TYPE_POS - buffer.size(), ' ');
+        buffer = buffer + to_string(entry.amount);
+        buffer = buffer + string(BALANCE_POS - buffer.size(), ' ');
+        buffer = buffer + to_string(entry.balance);
+        cout << buffer << '\n';
+    }
+    end_action("");
+}
+
+/*
+Querries the user for a past date and time until a valid one is given.
+Params:
+    - message: message to display when querrying the user
+Returns:
+    - The time in microseconds since the epoch.
+*/
+long long get_past_time(string message) {
+    while (true) {
+        cout << message;
+        istringstream input(get_user_input());
+        tm fields = {};
+        input >> get_time(&fields, "%Y-%m-%d %H:%M:%S");
+        if (input.fail()) {
+            cout << "Please enter a time in the form YYYY-MM-DD HH:MM:SS\n";
+            continue;
+        }
+        fields.tm_isdst = -1;
+        return mktime(&fields) * 1000000LL;
+    }
+}
+
+/*
+Displays the balance an account, or the whole bank, had at a past
+time requested by the user.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void historical_balance(Bank* bank) {
+    cout << "----Historical Balance----\n";
+    if (bank->is_lazy()) {
+        end_action("Historical balances are not kept for a lazily opened bank\n");
+        return;
+    }
+    cout << "Enter the account number (or 'all' for the whole bank): ";
+    string accStr = get_user_input();
+    long long time = get_past_time("Enter the time (YYYY-MM-DD HH:MM:SS): ");
+    if (accStr.compare("all") == 0) {
+        end_action("Total balance: " + to_string(bank->total_at(time)) + "\n");
+        return;
+    }
+    int accNum = convert_string_to_int(accStr);
+    Account::Balance balance;
+    if (accNum <= 0 || !bank->balance_at(accNum, time, &balance)) {
+        end_action("The account " + accStr + " did not exist at that time\n");
+        return;
+    }
+    end_action("Balance Amount: " + to_string(balance) + "\n");
+}
+
+/*
+Runs the end of day interest and fee postings over every account.
+Querries the user for a rates file, using the default rates if
+none is given.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void end_of_day(Bank* bank) {
+    cout << "----End Of Day Run----\n";
+    cout << "Enter the name of the rates file (leave blank for default rates): ";
+    string fileName = get_user_input();
+    AccrualConfig config = default_accrual_config();
+    if (!fileName.empty() && !load_accrual_config(fileName, &config)) {
+        end_action("Unable to load the rates file " + fileName + "\n");
+        return;
+    }
+    AccrualSummary summary = bank->run_accrual(config);
+    cout << "Interest postings: " << summary.interestPostings
+         << " (total " << to_string(summary.interestTotal) << ")\n";
+    cout << "Fee postings: " << summary.feePostings
+         << " (total " << to_string(summary.feeTotal) << ")\n";
+    cout << "Fees skipped for insufficient funds: " << summary.feesSkipped << "\n";
+    end_action("");
+}
+
+/*
+Splits a bulk update command into words. Words may be quoted with
+double quotes so that they can contain spaces, e.g. holder="A B".
+Params:
+    - command: the command
+Returns:
+    - The words of the command, with the quotes removed.
+*/
+vector<string> split_command(string command) {
+    vector<string> words;
+    string word;
+    bool quoted = false;
+    bool inWord = false;
+    for (size_t i = 0; i < command.size(); i++) {
+        char c = command[i];
+        if (c == '"') {
+            quoted = !quoted;
+            inWord = true;
+        } else if (c == ' ' && !quoted) {
+            if (inWord) {
+                words.push_back(word);
+            }
+            word.clear();
+            inWord = false;
+        } else {
+            word.push_back(c);
+            inWord = true;
+        }
+    }
+    if (inWord) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+/*
+Parses a bulk update command of the form
+    where <condition>... set <change>...
+A condition is one of number=A (or number=A-B for a range),
+type=S, holder=Name, or balance followed by <, <=, =, >= or > and
+an amount. A change is one of type=S, holder=Name or balance=Amount.
+Params:
+    - command: the command to parse
+    - predicate: set to the conditions of the command
+    - update: set to the changes of the command
+Returns:
+    - An empty string if the command was parsed, otherwise a
+    message explaining what is wrong with it.
+*/
+string parse_bulk_command(string command, BulkPredicate* predicate, BulkUpdate* update) {
+    *predicate = {INT_MIN, INT_MAX, "", false, "", -FLT_MAX, true, FLT_MAX, true};
+    *update = {false, "", false, "", false, 0};
+    vector<string> words = split_command(command);
+    if (words.empty() || words[0].compare("where") != 0) {
+        return "The command must start with 'where'";
+    }
+    bool inSet = false;
+    bool anyChange = false;
+    for (size_t i = 1; i < words.size(); i++) {
+        string word = words[i];
+        if (word.compare("set") == 0 && !inSet) {
+            inSet = true;
+            continue;
+        }
+        size_t opStart = word.find_first_of("<=>");
+        if (opStart == string::npos || opStart == 0) {
+            return "Could not understand '" + word + "'";
+        }
+        size_t valueStart = word.find_first_not_of("<=>", opStart);
+        string field = word.substr(0, opStart);
+        string op = word.substr(opStart, valueStart == string::npos ? string::npos : valueStart - opStart);
+        string value = valueStart == string::npos ? "" : word.substr(valueStart);
+        if (inSet) {
+            if (op.compare("=") != 0) {
+                return "Changes must use '=' in '" + word + "'";
+            }
+            if (field.compare("type") == 0) {
+                update->setType = true;
+                update->type = value;
+            } else if (field.compare("holder") == 0) {
+                update->setHolder = true;
+                update->holder = value;
+            } else if (field.compare("balance") == 0) {
+                update->setBalance = true;
+                update->balance = convert_string_to_float(value);
+                if (update->balance < 0) {
+                    return "Please enter a valid, non-negative balance in '" + word + "'";
+                }
+            } else {
+                return "Only type, holder and balance can be changed";
+            }
+            anyChange = true;
+        } else if (field.compare("number") == 0 && op.compare("=") == 0) {
+            size_t dash = value.find('-');
+            predicate->minNumber = convert_string_to_int(value.substr(0, dash));
+            predicate->maxNumber = dash == string::npos ? predicate->minNumber :
+                    convert_string_to_int(value.substr(dash + 1));
+            if (predicate->minNumber < 0 || predicate->maxNumber < 0) {
+                return "Please enter a valid account number or range in '" + word + "'";
+            }
+        } else if (field.compare("type") == 0 && op.compare("=") == 0) {
+            predicate->type = value;
+        } else if (field.compare("holder") == 0 && op.compare("=") == 0) {
+            predicate->matchHolder = true;
+            predicate->holder = value;
+        } else if (field.compare("balance") == 0) {
+            float amount = convert_string_to_float(value);
+            if (amount < 0) {
+                return "Please enter a valid, non-negative amount in '" + word + "'";
+            }
+            if (op.compare("<") == 0 || op.compare("<=") == 0) {
+                predicate->maxBalance = amount;
+                predicate->maxInclusive = op.compare("<=") == 0;
+            } else if (op.compare(">") == 0 || op.compare(">=") == 0) {
+                predicate->minBalance = amount;
+                predicate->minInclusive = op.compare(">=") == 0;
+            } else if (op.compare("=") == 0) {
+                predicate->minBalance = amount;
+                predicate->maxBalance = amount;
+            } else {
+                return "Could not understand '" + word + "'";
+            }
+        } else {
+            return "Could not understand '" + word + "'";
+        }
+    }
+    if (!anyChange) {
+        return "The command must end with 'set' and at least one change";
+    }
+    return "";
+}
+
+/*
+Changes every account matching a condition given by the user, after
+showing how many accounts match and asking for confirmation.
 Params:
-    - buffer: string to add the account number to.
-    - account: the account which the account number comes from
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void bulk_update(Bank* bank) {
+    cout << "----Bulk Update----\n";
+    cout << "Enter the update (e.g. where type=C balance<100 set type=S): ";
+    BulkPredicate predicate;
+    BulkUpdate update;
+    string error = parse_bulk_command(get_user_input(), &predicate, &update);
+    if (!error.empty()) {
+        end_action(error + "\n");
+        return;
+    }
+    int matched = bank->bulk_match(predicate).size();
+    cout << matched << " accounts match. Apply the update? (y/n): ";
+    if (get_user_input().compare("y") != 0) {
+        end_action("No accounts were changed\n");
+        return;
+    }
+    BulkSummary summary;
+    try {
+        summary = bank->bulk_update(predicate, update);
+    } catch (InvalidUpdateException &e) {
+        end_action(string(e.what()) + ". No accounts were changed\n");
+        return;
+    }
+    for (size_t i = 0; i < summary.accounts.size() && i < BULK_SUMMARY_ROWS; i++) {
+        cout << add_details_to_string("", bank->get_account(summary.accounts[i])) << '\n';
+    }
+    if (summary.accounts.size() > BULK_SUMMARY_ROWS) {
+        cout << "... and " << summary.accounts.size() - BULK_SUMMARY_ROWS << " more\n";
+    }
+    cout << "Accounts updated: " << summary.accounts.size() << "\n";
+    cout << "Balance of updated accounts: " << to_string(summary.balanceBefore) << " -> "
+         << to_string(summary.balanceAfter) << "\n";
+    end_action("");
+}
+
+/*
+Closes a bank account. Will querry the user and retrieve
+the account informaiton. If no account can be found then
+no operation is performed.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void close_account(Bank* bank) {
+    cout << "----Delete Record----\n";
+    int accNum = run_question_sequence("Enter the account number: ", 
+            convert_string_to_int);
+    try {
+        bank->delete_account(accNum);
+        end_action("Record Deleted\n");
+    } catch (AccountNotFoundException &e) {
+        cerr << "Account " << accNum << " does not exist." << endl;
+        end_action("");
+    }
+}
+
+/*
+Modifies an existing bank account. All details (account no., 
+holder, type, balance) are requested from the user. If no account 
+is found, no operation is performed.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void modify_account(Bank* bank) {
+    cout << "----Modify Record----\n";
+    int accNum = run_question_sequence("Enter the Account Number: ", 
+            convert_string_to_int);
+    Account* account;
+    try {
+        account = bank->get_account(accNum);
+    } catch (AccountNotFoundException &e) {
+        end_action("The account " + to_string(accNum) + " does not exist\n");
+        return;
+    }
+    account->display_account();;
+    int newAccNum = get_account_number(bank);
+    string newName = get_account_holder("Modify Account Holder Name: ");
+    string newAccType = get_type_of_account("Modify Type of Account: ");
+    float newBalance = get_balance("Modify Balance Amount: ");
+    try {
+        bank->modify_account(accNum, newAccNum, newName, newAccType, newBalance);
+    } catch (AccountAlreadyExistsException &e) {
+        end_action("An account with the account number " + to_string(newAccNum) + " already exists\n");
+        return;
+    }
+    end_action("Record Updated\n");
+}
+
+/*
+Quits the program when requested from the user in the main menu.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void quit_program(Bank*) {
+    cout << "Exiting...\n";
+    exit(NORMAL_EXIT);
+}
+
+/*
+Writes the status of the bank into a savefile, or into a snapshot if
+the file name ends in SNAPSHOT_EXTENSION. The file is written under a
+temporary name and renamed over the old one, so a crash never leaves
+a partly written savefile. The transaction history is saved next to
+it first. The savefile of a lazy bank is written by
+streaming its old savefile, and the new savefile's index is built as
+it is written.
+Params:
+    - bank: pointer to the main bank object
+    - fileName: name of the savefile to write
+Returns:
+    - bool true if the savefile was written, false if it could
+    not be opened.
+*/
+bool save_bank(Bank* bank, string fileName) {
+    bank->merge_hot();
+    if (!bank->save_history(fileName)) {
+        return false;
+    }
+    string outName = fileName + TEMP_SUFFIX;
+    if (file_extension(fileName).compare(SNAPSHOT_EXTENSION) == 0) {
+        if (!save_snapshot(bank, outName)) {
+            return false;
+        }
+        filesystem::rename(outName, fileName);
+        return true;
+    }
+    bool lazy = bank->is_lazy();
+    ofstream saveFile;
+    saveFile.open(outName);
+    if (!saveFile) {
+        return false;
+    }
+    string header = bank->name + '\n' + to_string(bank->get_num_of_accounts()) + '\n' +
+            ACCOUNT_SEP_LINE + '\n';
+    saveFile << header;
+    long long offset = header.size();
+    vector<IndexEntry> index;
+    int numOfAcc = 0;
+    bank->for_each_account([&](Account& account) {
+        if (numOfAcc > 0) {
+            saveFile << ACCOUNT_SEP_LINE << '\n';
+            offset += strlen(ACCOUNT_SEP_LINE) + 1;
+        }
+        string accountString = account.account_string();
+        if (lazy) {
+            index.push_back({account.get_acc_num(), 0, offset});
+        }
+        saveFile << accountString;
+        offset += accountString.size();
+        numOfAcc++;
+    });
+    saveFile << "END";
+    saveFile.close();
+    if (!saveFile) {
+        return false;
+    }
+    filesystem::rename(outName, fileName);
+    if (lazy) {
+        write_savefile_index(fileName, index);
+        bank->open_source(fileName, numOfAcc);
+    }
+    return true;
+}
+
+/*
+When requested by the user in the main menu, this function saves
+the status of the bank into a text file requested by the user.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void save(Bank* bank) {
+    cout << "----Save Bank Status-----\n";
+    cout << "Enter the name of the file: ";
+    string fileName = get_user_input();
+    if (!save_bank(bank, fileName)) {
+        cerr << BAD_FILE << endl;
+        exit(CANNOT_OPEN_FILE);
+    }
+}
+
+/*
+Function to handle the request from the user
+Params:
+    - inputNum: number which the user has selected
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void handle_input(int inputNum, Bank* bank) {
+    switch (inputNum) {
+        case 1: new_account(bank, "----New Account Entry Form----\n"); break;
+        case 2: deposit(bank); break;
+        case 3: withdraw(bank); break;
+        case 4: balance_enquiry(bank); break;
+        case 5: account_holders(bank); break;
+        case 6: close_account(bank); break;
+        case 7: modify_account(bank); break;
+        case 8: quit_program(bank); break;
+        case 9: save(bank); break;
+        case 10: account_statement(bank); break;
+        case 11: historical_balance(bank); break;
+        case 12: end_of_day(bank); break;
+        case 13: bulk_update(bank); break;
+    }
+}
+
+/*
+Performs the main menu operation for the banking system.
+Will display the options then querry the user for their
+selection. It will then go onto to execute that operation.
+Params:
+    - bank: pointer to the main bank object
+Returns:
+    - void
+*/
+void run_bank(Bank* bank) {
+    string mainMenu = "Main Menu:\n1. New Account\n2. Deposit Amount\n3. \
+Withdraw Amount\n4. Balance Enquiry\n5. All Account Holders List\n6. Close \
+An Account\n7. Modify An Account\n8. Exit\n9. Save Bank Status\n10. Statement\n\
+11. Historical Balance\n12. End Of Day Run\n13. Bulk Update\nSelect your option (1-13)\n";
+    string errMessage = "Please enter a number between 1 to 13\n";
+    string input;
+    int inputNum;
+    while (true) {
+        cout << bank->name << "\n";
+        cout << mainMenu;
+        getline(cin, input);
+        inputNum = convert_string_to_int(input);
+        if (inputNum < 1 || inputNum > 13) {
+            cout << errMessage;
+        }
+        handle_input(inputNum, bank);
+    }
+}
+
+/*
+Read-only replica of a bank, kept up to date by a background thread
+that tails the journal written by a primary started with --journal.
+The journal begins with the opening of every account, so a follower
+can start at any time, and any number of followers can tail the same
+journal without slowing the primary. If the primary restarts, the
+journal is replaced and the follower rebuilds its bank from the new one.
+*/
+class Follower {
+    private:
+        /*Private member variable for the lock held while the bank is used.*/
+        mutex lock;
+        /*Private member variable for the replicated bank.*/
+        Bank* bank;
+        /*Private member variable for the journal being tailed.*/
+        string path;
+        /*Private member variable for the thread tailing the journal.*/
+        thread tailer;
+        /*Private member variable for the number of journal bytes read.*/
+        long long offset;
+        /*Private member variable for the sequence number of the last change applied.*/
+        unsigned long long lastSequence;
+        /*Private member variable for the number of changes applied.*/
+        long long numberOfChanges;
+        /*Private member variable for the time the last change was made on the primary.*/
+        long long lastChangeTime;
+        /*Private member variable for the time the last change was applied here.*/
+        long long lastAppliedTime;
+        /*Private member variable set if a change was lost or could not be applied.*/
+        bool diverged;
+
+        /*
+        Method to empty the replicated bank, ready to read a new journal.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void reset(void) {
+            delete bank;
+            bank = new Bank("Replica of " + path);
+            offset = 0;
+            lastSequence = 0;
+            numberOfChanges = 0;
+            lastChangeTime = 0;
+            lastAppliedTime = 0;
+            diverged = false;
+        }
+
+        /*
+        Method to apply one line of the journal to the bank.
+        Params:
+            - line: the change, as a JSON line
+        Returns:
+            - void
+        */
+        void apply(const string& line) {
+            string event;
+            string holder;
+            string type;
+            int accNum = 0;
+            int newAccNum = 0;
+            float balance = 0;
+            unsigned long long sequence = 0;
+            long long time = 0;
+            for_each_json_field(line, [&](const string& key, const string& value) {
+                if (key.compare("event") == 0) {
+                    event = value;
+                } else if (key.compare("seq") == 0) {
+                    sequence = strtoull(value.c_str(), NULL, 10);
+                } else if (key.compare("time") == 0) {
+                    time = strtoll(value.c_str(), NULL, 10);
+                } else if (key.compare("account") == 0) {
+                    accNum = atoi(value.c_str());
+                } else if (key.compare("newAccount") == 0) {
+                    newAccNum = atoi(value.c_str());
+                } else if (key.compare("holder") == 0) {
+                    holder = value;
+                } else if (key.compare("type") == 0) {
+                    type = value;
+                } else if (key.compare("balance") == 0) {
+                    balance = strtof(value.c_str(), NULL);
+                }
+            });
+            if (event.compare("overflow") == 0 || sequence != lastSequence + 1) {
+                diverged = true;
+            }
+            if (event.compare("overflow") == 0) {
+                return;
+            }
+            try {
+                if (event.compare("open") == 0) {
+                    bank->add_account(newAccNum, holder, type, balance);
+                } else if (event.compare("close") == 0) {
+                    bank->delete_account(accNum);
+                } else {
+                    bank->modify_account(accNum, newAccNum, holder, type, balance);
+                }
+            } catch (std::exception &e) {
+                diverged = true;
+            }
+            lastSequence = sequence;
+            numberOfChanges++;
+            lastChangeTime = time;
+            lastAppliedTime = current_time();
+        }
+
+        /*
+        Method run by the tailing thread. Reads the journal as it is
+        written, applying each complete line, and starts again from
+        an empty bank when the journal is replaced.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void run(void) {
+            vector<char> buffer(FOLLOW_READ_SIZE);
+            string pending;
+            int journal = -1;
+            while (true) {
+                if (journal < 0) {
+                    journal = open(path.c_str(), O_RDONLY);
+                    if (journal < 0) {
+                        this_thread::sleep_for(chrono::milliseconds(FOLLOW_POLL_MS));
+                        continue;
+                    }
+                }
+                ssize_t length = ::read(journal, buffer.data(), buffer.size());
+                if (length <= 0) {
+                    struct stat opened;
+                    struct stat named;
+                    if (fstat(journal, &opened) == 0 && stat(path.c_str(), &named) == 0 &&
+                            opened.st_ino != named.st_ino) {
+                        close(journal);
+                        journal = -1;
+                        pending.clear();
+                        lock_guard<mutex> guard(lock);
+                        reset();
+                        continue;
+                    }
+                    this_thread::sleep_for(chrono::milliseconds(FOLLOW_POLL_MS));
+                    continue;
+                }
+                pending.append(buffer.data(), length);
+                lock_guard<mutex> guard(lock);
+                offset += length;
+                size_t start = 0;
+                size_t end;
+                while ((end = pending.find('\n', start)) != string::npos) {
+                    apply(pending.substr(start, end - start));
+                    start = end + 1;
+                }
+                pending.erase(0, start);
+            }
+        }
+
+    public:
+        /*
+        Instantiates a follower of a journal and starts tailing it.
+        Params:
+            - path: the journal written by the primary
+        */
+        Follower(string path) {
+            this->path = path;
+            bank = NULL;
+            reset();
+            tailer = thread(&Follower::run, this);
+            tailer.detach();
+        }
+
+        /*
+        Method to use the replicated bank. Changes are not applied
+        while the function runs, so it should not wait on the user.
+        Params:
+            - visit: function called with a pointer to the bank
+        Returns:
+            - void
+        */
+        void read(function<void(Bank*)> visit) {
+            lock_guard<mutex> guard(lock);
+            visit(bank);
+        }
+
+        /*
+        Method to display how far the replica is behind the primary.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void display_status(void) {
+            lock_guard<mutex> guard(lock);
+            struct stat info;
+            long long behind = stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode) ?
+                    max(0LL, (long long) info.st_size - offset) : 0;
+            cout << "Journal: " << path << '\n';
+            cout << "Changes applied: " << numberOfChanges << '\n';
+            if (numberOfChanges > 0) {
+                cout << "Replication lag: " << (lastAppliedTime - lastChangeTime) / 1000.0
+                     << " ms (last change made " << (current_time() - lastChangeTime) / 1000000
+                     << " s ago)\n";
+            }
+            if (behind > 0) {
+                cout << "Behind the journal by " << behind << " bytes\n";
+            } else {
+                cout << "Caught up with the journal\n";
+            }
+            if (diverged) {
+                cout << "Changes were lost or could not be applied, the replica may not match the primary\n";
+            }
+        }
+};
+
+/*
+Performs the balance enquiry operation on a replica.
+Params:
+    - follower: pointer to the replica
+Returns:
+    - void
+*/
+void replica_balance_enquiry(Follower* follower) {
+    cout << "Balance Details.\n";
+    int accNum = run_question_sequence("Enter the account number: ", 
+            convert_string_to_int);
+    bool found = true;
+    follower->read([&](Bank* bank) {
+        try {
+            bank->get_account(accNum)->display_account();
+        } catch (AccountNotFoundException &e) {
+            found = false;
+        }
+    });
+    end_action(found ? "" : "The account " + to_string(accNum) + " does not exist\n");
+}
+
+/*
+Performs the read-only main menu of a replica.
+Params:
+    - follower: pointer to the replica
 Returns:
-    - The buffer string with the concatenated account number.
+    - void
 */
-string add_account_num(string buffer, Account* account) {
-    int accNum = account->get_acc_num();
-    string accNumStr = to_string(accNum);
-    buffer = buffer + accNumStr;
-    buffer = buffer + string(NAME_POS - accNumStr.size(), ' ');
-    return buffer;
+void run_follower(Follower* follower) {
+    string mainMenu = "Replica Menu:\n1. Balance Enquiry\n2. All Account Holders List\n\
+3. Replication Status\n4. Exit\nSelect your option (1-4)\n";
+    string errMessage = "Please enter a number between 1 to 4\n";
+    string input;
+    int inputNum;
+    while (true) {
+        cout << mainMenu;
+        getline(cin, input);
+        inputNum = convert_string_to_int(input);
+        switch (inputNum) {
+            case 1: replica_balance_enquiry(follower); break;
+            case 2: {
+                int sortBy = get_sort_order();
+                follower->read([&](Bank* bank) {
+                    list_account_holders(bank, sortBy);
+                });
+                break;
+            }
+            case 3: follower->display_status(); end_action(""); break;
+            case 4: cout << "Exiting...\n"; exit(NORMAL_EXIT);
+            default: cout << errMessage;
+        }
+    }
 }
 
 /*
-Given a string (buffer) adds the account holder to this string
+Makes accounts of a bank hot (see Bank::mark_hot), exiting if one of
+them does not exist.
 Params:
-    - buffer: string to add the account holder to.
-    - account: the account which the account holder comes from
+    - bank: pointer to the bank
+    - numbers: comma separated account numbers, or empty
 Returns:
-    - The buffer string with the concatenated account holder.
+    - void
 */
-string add_holder(string buffer, Account* account) {
-    string holder = account->get_holder();
-    buffer = buffer + holder;
-    buffer = buffer + string(TYPE_POS - buffer.size(), ' ');
-    return buffer;
+void mark_hot_accounts(Bank* bank, string numbers) {
+    istringstream list(numbers);
+    string number;
+    while (getline(list, number, ',')) {
+        try {
+            bank->mark_hot(convert_string_to_int(number));
+        } catch (AccountNotFoundException &e) {
+            cerr << "Hot account " << number << ": " << e.what() << endl;
+            exit(BAD_ARGS);
+        }
+    }
 }
 
 /*
-Given a string (buffer) adds the account type to this string
+Result of a command run by execute_command.
+*/
+struct CommandResult {
+    /*Whether the command succeeded.*/
+    bool ok;
+    /*Whether the command changed the bank, and so must be journalled.*/
+    bool mutated;
+    /*Reason the command failed.*/
+    string error;
+    /*Accounts shown by the command.*/
+    vector<AccountRecord> accounts;
+};
+
+/*
+Makes a record of an account's details.
 Params:
-    - buffer: string to add the account type to.
-    - account: the account which the account type comes from
+    - account: the account
 Returns:
-    - The buffer string with the concatenated account type.
+    - The record.
 */
-string add_type(string buffer, Account* account) {
-    string type = account->get_type();
-    buffer = buffer + type;
-    buffer = buffer + string(BALANCE_POS - buffer.size(), ' ');
-    return buffer;
+AccountRecord account_record(Account* account) {
+    AccountRecord record;
+    record.accNum = account->get_acc_num();
+    record.holder = account->get_holder();
+    record.type = account->get_type();
+    record.balance = account->get_balance();
+    return record;
 }
 
 /*
-Given a string (buffer) adds the account balance to this string
+Makes an account record from the arguments of a command.
 Params:
-    - buffer: string to add the account balance to.
-    - account: the account which the account balance comes from
+    - words: the command and its arguments
+    - first: position of the account number in words, followed by
+    the holder, type and balance
 Returns:
-    - The buffer string with the concatenated account balance.
+    - The record, with an account number of -1 if an argument is invalid.
 */
-string add_balance(string buffer, Account* account) {
-    float balance = account->get_balance();
-    string balanceStr = to_string(balance);
-    buffer = buffer + balanceStr;
-    return buffer;
+AccountRecord command_record(const vector<string>& words, size_t first) {
+    AccountRecord record;
+    record.accNum = convert_string_to_int(words.at(first));
+    record.holder = words.at(first + 1);
+    record.type = words.at(first + 2);
+    record.balance = convert_string_to_float(words.at(first + 3));
+    if (!valid_record(record)) {
+        record.accNum = -1;
+    }
+    return record;
 }
 
 /*
-Adds the details of the account to the string buffer.
+Runs one command, given as words split by split_command, against
+a bank. The caller must make sure no other thread uses the bank.
+Commands are:
+    open number holder type balance
+    deposit number amount
+    withdraw number amount
+    show number (or balance number)
+    list [number|name|balance]
+    close number
+    modify number new-number holder type balance
+    save file
 Params:
-    - buffer: string to add the account details to
-    - account: account in which the details are to
-    be added from
+    - bank: pointer to the bank
+    - words: the command and its arguments
 Returns:
-    - The buffer string with the account details concatenated
-    onto the end of it.
+    - The result of the command.
 */
-string add_details_to_string(string buffer, Account* account) {
-    buffer = add_account_num(buffer, account);
-    buffer = add_holder(buffer, account);
-    buffer = add_type(buffer, account);
-    buffer = add_balance(buffer , account);
-    return buffer;
+CommandResult execute_command(Bank* bank, const vector<string>& words) {
+    CommandResult result;
+    result.ok = false;
+    result.mutated = false;
+    const string& name = words.at(0);
+    size_t numberOfWords = words.size();
+    try {
+        int accNum = numberOfWords > 1 ? convert_string_to_int(words.at(1)) : -1;
+        float amount = numberOfWords > 2 ? convert_string_to_float(words.at(2)) : -1;
+        if ((name.compare("show") == 0 || name.compare("balance") == 0) &&
+                numberOfWords == 2 && accNum > 0) {
+            Account account = bank->copy_account(accNum);
+            result.accounts.push_back(account_record(&account));
+        } else if ((name.compare("deposit") == 0 || name.compare("withdraw") == 0) &&
+                numberOfWords == 3 && accNum > 0 && amount > 0) {
+            Account account = bank->change_and_copy(accNum,
+                    name.compare("deposit") == 0 ? amount : -amount);
+            result.mutated = true;
+            result.accounts.push_back(account_record(&account));
+        } else if (name.compare("open") == 0 && numberOfWords == 5 &&
+                command_record(words, 1).accNum > 0) {
+            AccountRecord record = command_record(words, 1);
+            bank->add_account(record.accNum, record.holder, record.type, record.balance);
+            result.mutated = true;
+            result.accounts.push_back(record);
+        } else if (name.compare("close") == 0 && numberOfWords == 2 && accNum > 0) {
+            bank->delete_account(accNum);
+            result.mutated = true;
+        } else if (name.compare("modify") == 0 && numberOfWords == 6 && accNum > 0 &&
+                command_record(words, 2).accNum > 0) {
+            AccountRecord record = command_record(words, 2);
+            bank->modify_account(accNum, record.accNum, record.holder, record.type, record.balance);
+            result.mutated = true;
+            result.accounts.push_back(record);
+        } else if (name.compare("list") == 0 && numberOfWords <= 2) {
+            int sortBy = SORT_BY_INSERTION;
+            if (numberOfWords == 2) {
+                const string& key = words.at(1);
+                sortBy = key.compare("number") == 0 ? SORT_BY_NUMBER :
+                        key.compare("name") == 0 ? SORT_BY_NAME :
+                        key.compare("balance") == 0 ? SORT_BY_BALANCE : -1;
+            }
+            if (sortBy == SORT_BY_INSERTION) {
+                result.accounts.reserve(bank->get_num_of_accounts());
+                bank->for_each_account([&](Account& account) {
+                    result.accounts.push_back(account_record(&account));
+                });
+            } else if (sortBy != -1) {
+                vector<int> positions = bank->sorted_positions(sortBy);
+                result.accounts.reserve(positions.size());
+                for (size_t i = 0; i < positions.size(); i++) {
+                    result.accounts.push_back(account_record(bank->get_account_at(positions[i])));
+                }
+            } else {
+                result.error = "Unknown sort order";
+                return result;
+            }
+        } else if (name.compare("save") == 0 && numberOfWords == 2) {
+            if (!save_bank(bank, words.at(1))) {
+                result.error = BAD_FILE;
+                return result;
+            }
+        } else {
+            result.error = "Unknown command or bad arguments";
+            return result;
+        }
+    } catch (std::exception &e) {
+        result.error = e.what();
+        return result;
+    }
+    result.ok = true;
+    return result;
 }
 
 /*
-Determines whether or not the new account number from the user
-is unique and is not already in use.
+Appends the result of a command to a buffer as one tab separated
+line: "OK" followed by the number, holder, type and balance of each
+account shown, or "ERR" followed by the reason the command failed.
 Params:
-    - accNum: number requested for the new account
-    - bank: pointer to the main bank object
+    - result: the result of the command
+    - buffer: string to add the line to
 Returns:
-    - True if the requested account number is already in use
-    - False otherwise.
+    - void
 */
-bool not_unique(Bank* bank, int accNum) {
-    vector<Account> accounts = bank->get_accounts();
-    for (int i = 0; i < bank->get_num_of_accounts(); i++) {
-        if (accounts.at(i).get_acc_num() == accNum) {
-            return true;
-        }
+void format_result_tsv(CommandResult& result, string& buffer) {
+    if (!result.ok) {
+        buffer += "ERR\t" + result.error + '\n';
+        return;
     }
-    return false;
+    buffer += "OK";
+    for (size_t i = 0; i < result.accounts.size(); i++) {
+        AccountRecord& record = result.accounts[i];
+        buffer += '\t' + to_string(record.accNum) + '\t' + record.holder + '\t' +
+                record.type + '\t' + to_string(record.balance);
+    }
+    buffer += '\n';
 }
 
 /*
-Creates a new account for the banking system. Will request user
-input regarding the account details.
+Appends the result of a command to a buffer as one line of JSON, e.g.
+{"ok": true, "accounts": [{"number": 1001, ...}]} or
+{"ok": false, "error": "..."}.
 Params:
-    - bank: pointer to the main bank object
-    - message: initial message to display to the terminal.
+    - result: the result of the command
+    - buffer: string to add the line to
 Returns:
     - void
 */
-void new_account(Bank* bank, string message) {
-    cout << message;
-    int accountNumber;
-    string accountHolder, accType;
-    float amount;
-    accountNumber = get_account_number(bank);
-    if (not_unique(bank, accountNumber)) {
-        end_action("An account with the account number " + to_string(accountNumber) + " already exists\n");
+void format_result_json(CommandResult& result, string& buffer) {
+    if (!result.ok) {
+        buffer += "{\"ok\": false, \"error\": \"" + result.error + "\"}\n";
         return;
     }
-    accountHolder = get_account_holder("Enter the name of the account holder: ");
-    accType = get_type_of_account("Enter the type of the account (type 'S' for savings or 'C' for current): ");
-    amount = get_balance("Enter initial amount: ");
-    bank->add_account(accountNumber, accountHolder, accType, amount);
-    end_action("Account was set up succesfully\n");
+    buffer += "{\"ok\": true, \"accounts\": [";
+    for (size_t i = 0; i < result.accounts.size(); i++) {
+        AccountRecord& record = result.accounts[i];
+        buffer += i == 0 ? "" : ", ";
+        buffer += "{\"number\": " + to_string(record.accNum) +
+                ", \"holder\": \"" + record.holder +
+                "\", \"type\": \"" + record.type +
+                "\", \"balance\": " + to_string(record.balance) + "}";
+    }
+    buffer += "]}\n";
+}
+
+/*
+Runs commands read from standard input, one per line (see
+execute_command), writing a one line result for each in TSV, or in
+JSON if --json is given. There are no prompts, and results are
+buffered and only written out once no more input is waiting, so
+scripts run as fast as the commands do.
+Params:
+    - argc: number of input arguments
+    - argv: for the arguments
+Returns:
+    - Exit status of the program.
+*/
+int run_script(int argc, char** argv) {
+    bool json = false;
+    string savefile;
+    for (int i = 2; i < argc; i++) {
+        if (string(argv[i]).compare("--json") == 0 && !json) {
+            json = true;
+        } else if (savefile.empty()) {
+            savefile = argv[i];
+        } else {
+            print_usage();
+        }
+    }
+    Bank* bank = savefile.empty() ? new Bank("Script") : load_bank(savefile);
+    ios::sync_with_stdio(false);
+    cin.tie(NULL);
+    string line;
+    string output;
+    while (getline(cin, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        vector<string> words = split_command(line);
+        if (words.empty()) {
+            continue;
+        }
+        CommandResult result = execute_command(bank, words);
+        if (json) {
+            format_result_json(result, output);
+        } else {
+            format_result_tsv(result, output);
+        }
+        if (output.size() >= SCRIPT_FLUSH_BYTES || cin.rdbuf()->in_avail() <= 0) {
+            cout.write(output.data(), output.size());
+            cout.flush();
+            output.clear();
+        }
+    }
+    cout.write(output.data(), output.size());
+    cout.flush();
+    delete bank;
+    return NORMAL_EXIT;
+}
+
+/*
+Coroutine started by a server and left to run on its own. It runs
+until its first suspension on the thread that started it, then on
+whichever executor thread resumes it, and frees itself when done.
+*/
+struct ServerTask {
+    struct promise_type {
+        ServerTask get_return_object(void) {
+            return ServerTask();
+        }
+        suspend_never initial_suspend(void) noexcept {
+            return suspend_never();
+        }
+        suspend_never final_suspend(void) noexcept {
+            return suspend_never();
+        }
+        void return_void(void) {}
+        void unhandled_exception(void) {
+            terminate();
+        }
+    };
+};
+
+/*
+Small pool of threads resuming suspended coroutines.
+*/
+class ServerExecutor {
+    private:
+        /*Private member variable for the coroutines ready to be resumed.*/
+        ShardQueue ready;
+        /*Private member variable for the threads resuming them.*/
+        vector<thread> workers;
+
+    public:
+        /*
+        Instantiates an executor and starts its threads.
+        Params:
+            - numberOfThreads: number of threads
+        */
+        ServerExecutor(int numberOfThreads) {
+            for (int i = 0; i < numberOfThreads; i++) {
+                workers.push_back(thread([this] {
+                    function<void()> resume;
+                    while (ready.pop(resume)) {
+                        resume();
+                    }
+                }));
+            }
+        }
+
+        /*
+        Stops the threads once every queued coroutine has been resumed.
+        */
+        ~ServerExecutor(void) {
+            ready.close();
+            for (size_t i = 0; i < workers.size(); i++) {
+                workers[i].join();
+            }
+        }
+
+        /*
+        Method to queue a suspended coroutine to be resumed.
+        Params:
+            - handle: the coroutine
+        Returns:
+            - void
+        */
+        void post(coroutine_handle<> handle) {
+            ready.push([handle] { handle.resume(); });
+        }
+};
+
+/*
+Waits for sockets to become ready with epoll and queues the coroutine
+waiting on each one on the executor. Each socket may have only one
+coroutine waiting on it at a time.
+*/
+class ServerReactor {
+    private:
+        /*Private member variable for the epoll instance.*/
+        int epoll;
+        /*Private member variable for the executor resuming coroutines.*/
+        ServerExecutor* executor;
+        /*Private member variable for the thread waiting on epoll.*/
+        thread poller;
+
+    public:
+        /*
+        Awaitable suspending a coroutine until a socket is ready.
+        */
+        struct Readiness {
+            /*The reactor to wait with.*/
+            ServerReactor* reactor;
+            /*The socket to wait on.*/
+            int fd;
+            /*The epoll events to wait for.*/
+            unsigned int events;
+
+            bool await_ready(void) {
+                return false;
+            }
+            void await_suspend(coroutine_handle<> handle) {
+                epoll_event event = {};
+                event.events = events | EPOLLONESHOT;
+                event.data.ptr = handle.address();
+                if (epoll_ctl(reactor->epoll, EPOLL_CTL_MOD, fd, &event) != 0) {
+                    epoll_ctl(reactor->epoll, EPOLL_CTL_ADD, fd, &event);
+                }
+            }
+            void await_resume(void) {}
+        };
+
+        /*
+        Instantiates a reactor and starts its thread.
+        Params:
+            - executor: the executor to resume waiting coroutines on
+        */
+        ServerReactor(ServerExecutor* executor) {
+            this->executor = executor;
+            epoll = epoll_create1(EPOLL_CLOEXEC);
+            poller = thread([this] {
+                epoll_event events[SERVER_EVENTS];
+                while (true) {
+                    int numberOfEvents = epoll_wait(epoll, events, SERVER_EVENTS, -1);
+                    for (int i = 0; i < numberOfEvents; i++) {
+                        this->executor->post(coroutine_handle<>::from_address(events[i].data.ptr));
+                    }
+                }
+            });
+            poller.detach();
+        }
+
+        /*
+        Method to wait for a socket to become ready.
+        Params:
+            - fd: the socket
+            - events: EPOLLIN to wait until it can be read, EPOLLOUT
+            until it can be written
+        Returns:
+            - Awaitable resuming the coroutine on the executor once ready.
+        */
+        Readiness ready(int fd, unsigned int events) {
+            return Readiness{this, fd, events};
+        }
+};
+
+/*
+Journal of the commands that changed a served bank, written by a
+thread of its own. Appends are given tickets in order; a coroutine
+waits for its ticket to be written and synced, so every command
+appended while the previous batch was being synced is written with a
+single sync.
+*/
+class CommandJournal {
+    private:
+        /*Private member variable to guard the journal's state.*/
+        mutex lock;
+        /*Private member variable to wake the writer on new commands.*/
+        condition_variable pendingReady;
+        /*Private member variable to wake anyone waiting for every command to be synced.*/
+        condition_variable synced;
+        /*Private member variable for the commands not yet written.*/
+        string pending;
+        /*Private member variable for the ticket of the last command appended.*/
+        unsigned long long appended;
+        /*Private member variable for the ticket of the last command synced.*/
+        unsigned long long durable;
+        /*Private member variable for the coroutines waiting for a ticket to be synced.*/
+        vector<pair<unsigned long long, coroutine_handle<>>> waiting;
+        /*Private member variable for the journal file.*/
+        int file;
+        /*Private member variable for the executor resuming coroutines.*/
+        ServerExecutor* executor;
+        /*Private member variable for the writing thread.*/
+        thread writer;
+
+        /*
+        Method run by the writing thread. Writes and syncs the pending
+        commands in batches, then resumes the coroutines waiting on them.
+        Params:
+            - void
+        Returns:
+            - void
+        */
+        void run(void) {
+            string batch;
+            while (true) {
+                unsigned long long target;
+                {
+                    unique_lock<mutex> guard(lock);
+                    pendingReady.wait(guard, [this] { return !pending.empty(); });
+                    batch.swap(pending);
+                    target = appended;
+                }
+                size_t written = 0;
+                while (written < batch.size()) {
+                    ssize_t result = write(file, batch.data() + written, batch.size() - written);
+                    if (result <= 0) {
+                        cerr << BAD_FILE << endl;
+                        exit(CANNOT_OPEN_FILE);
+                    }
+                    written += result;
+                }
+                fdatasync(file);
+                batch.clear();
+                vector<coroutine_handle<>> resumable;
+                {
+                    lock_guard<mutex> guard(lock);
+                    durable = target;
+                    for (size_t i = 0; i < waiting.size();) {
+                        if (waiting[i].first <= durable) {
+                            resumable.push_back(waiting[i].second);
+                            waiting[i] = waiting.back();
+                            waiting.pop_back();
+                        } else {
+                            i++;
+                        }
+                    }
+                }
+                synced.notify_all();
+                for (size_t i = 0; i < resumable.size(); i++) {
+                    executor->post(resumable[i]);
+                }
+            }
+        }
+
+    public:
+        /*
+        Awaitable suspending a coroutine until a ticket is synced.
+        */
+        struct Sync {
+            /*The journal written to.*/
+            CommandJournal* journal;
+            /*The ticket to wait for.*/
+            unsigned long long ticket;
+
+            bool await_ready(void) {
+                lock_guard<mutex> guard(journal->lock);
+                return journal->durable >= ticket;
+            }
+            bool await_suspend(coroutine_handle<> handle) {
+                lock_guard<mutex> guard(journal->lock);
+                if (journal->durable >= ticket) {
+                    return false;
+                }
+                journal->waiting.push_back(make_pair(ticket, handle));
+                return true;
+            }
+            void await_resume(void) {}
+        };
+
+        /*
+        Instantiates a journal and starts its thread.
+        Params:
+            - file: the journal file, opened for appending
+            - executor: the executor to resume waiting coroutines on
+        */
+        CommandJournal(int file, ServerExecutor* executor) {
+            this->file = file;
+            this->executor = executor;
+            appended = 0;
+            durable = 0;
+            writer = thread(&CommandJournal::run, this);
+            writer.detach();
+        }
+
+        /*
+        Method to add a command to the journal. Commands must be
+        appended in the order they were run on the bank.
+        Params:
+            - command: the command
+        Returns:
+            - The ticket to wait for with synced.
+        */
+        unsigned long long append(const string& command) {
+            unsigned long long ticket;
+            {
+                lock_guard<mutex> guard(lock);
+                pending += command;
+                pending += '\n';
+                ticket = ++appended;
+            }
+            pendingReady.notify_one();
+            return ticket;
+        }
+
+        /*
+        Method to wait for a command to be written and synced.
+        Params:
+            - ticket: the ticket returned by append
+        Returns:
+            - Awaitable resuming the coroutine on the executor once synced.
+        */
+        Sync synced_to(unsigned long long ticket) {
+            return Sync{this, ticket};
+        }
+
+        /*
+        Method to empty the journal once the bank has been saved,
+        leaving only a header naming the savefile it now applies to.
+        Waits for every command appended to be synced first. No
+        commands may be appended meanwhile.
+        Params:
+            - header: the header line
+        Returns:
+            - void
+        */
+        void clear(string header) {
+            unique_lock<mutex> guard(lock);
+            synced.wait(guard, [this] { return durable == appended; });
+            header += '\n';
+            if (ftruncate(file, 0) != 0 ||
+                    write(file, header.data(), header.size()) != (ssize_t) header.size()) {
+                cerr << BAD_FILE << endl;
+            }
+            fdatasync(file);
+        }
+};
+
+/*
+State shared by the coroutines of a bank server.
+*/
+struct BankServer {
+    /*The bank served.*/
+    Bank* bank;
+    /*Lock held while the bank is used; shared by deposits into hot accounts.*/
+    shared_mutex bankLock;
+    /*The savefile the bank is saved to.*/
+    string savefile;
+    /*The socket accepting clients.*/
+    int listener;
+    /*Threads running the coroutines.*/
+    ServerExecutor* executor;
+    /*Waits for sockets to become ready.*/
+    ServerReactor* reactor;
+    /*Journal of the commands that changed the bank.*/
+    CommandJournal* journal;
+};
+
+/*
+Function to build the header line a server's journal starts with,
+naming the savefile whose contents the journalled commands follow.
+Params:
+    - savefile: name of the served savefile
+Returns:
+    - The header line.
+*/
+string journal_header(string savefile) {
+    return string(JOURNAL_HEADER) + " " + file_stamp(savefile);
+}
+
+/*
+Serves one client. Each line read is parsed, run against the bank and,
+if it changed the bank, added to the journal; once every change read
+together has been synced, the replies are written back. A client
+sending a line longer than SERVER_MAX_LINE is told so and dropped. The
+coroutine suspends instead of blocking while waiting on the client or
+the journal.
+Params:
+    - server: the server
+    - client: the client's socket
+Returns:
+    - The coroutine.
+*/
+ServerTask serve_client(BankServer* server, int client) {
+    char buffer[SERVER_READ_SIZE];
+    string input;
+    string output;
+    bool dropping = false;
+    while (!dropping) {
+        ssize_t length = ::read(client, buffer, sizeof(buffer));
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            co_await server->reactor->ready(client, EPOLLIN);
+            continue;
+        }
+        if (length <= 0) {
+            break;
+        }
+        input.append(buffer, length);
+        unsigned long long ticket = 0;
+        size_t start = 0;
+        size_t end;
+        while ((end = input.find('\n', start)) != string::npos) {
+            string line = input.substr(start, end - start);
+            start = end + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            vector<string> words = split_command(line);
+            if (words.empty()) {
+                continue;
+            }
+            CommandResult result;
+            if (words.at(0).compare("deposit") == 0 && words.size() == 3) {
+                shared_lock<shared_mutex> guard(server->bankLock);
+                int accNum = convert_string_to_int(words.at(1));
+                float amount = convert_string_to_float(words.at(2));
+                Bank::Hot* hotBalance = accNum > 0 && amount > 0 ?
+                        server->bank->deposit_hot(accNum, amount) : NULL;
+                if (hotBalance != NULL) {
+                    result.ok = true;
+                    result.accounts.push_back(AccountRecord{hotBalance->accNum,
+                            hotBalance->holder, hotBalance->type, hotBalance->total()});
+                    ticket = server->journal->append(line);
+                    format_result_tsv(result, output);
+                    continue;
+                }
+            }
+            {
+                unique_lock<shared_mutex> guard(server->bankLock);
+                if (words.at(0).compare("save") == 0 && words.size() == 1) {
+                    try {
+                        result.ok = save_bank(server->bank, server->savefile);
+                    } catch (std::exception &e) {
+                        result.ok = false;
+                    }
+                    result.error = BAD_FILE;
+                    if (result.ok) {
+                        server->journal->clear(journal_header(server->savefile));
+                    }
+                } else if (words.at(0).compare("save") == 0) {
+                    result.error = "Only the served savefile can be saved";
+                } else {
+                    result = execute_command(server->bank, words);
+                    if (result.mutated) {
+                        ticket = server->journal->append(line);
+                    }
+                }
+            }
+            format_result_tsv(result, output);
+        }
+        input.erase(0, start);
+        if (input.size() > SERVER_MAX_LINE) {
+            CommandResult result;
+            result.error = "Line too long";
+            format_result_tsv(result, output);
+            input.clear();
+            dropping = true;
+        }
+        if (ticket != 0) {
+            co_await server->journal->synced_to(ticket);
+        }
+        size_t written = 0;
+        while (written < output.size()) {
+            ssize_t result = write(client, output.data() + written, output.size() - written);
+            if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                co_await server->reactor->ready(client, EPOLLOUT);
+                continue;
+            }
+            if (result <= 0) {
+                close(client);
+                co_return;
+            }
+            written += result;
+        }
+        output.clear();
+    }
+    close(client);
 }
 
 /*
-Performs a deposit into the requested bank account. Will
-querry the user to get the account details, and the amount
-to deposit. If no account is found, no operation is performed.
+Accepts clients for as long as the server runs, starting a coroutine
+to serve each one.
 Params:
-    - bank: pointer to the main bank object.
+    - server: the server
 Returns:
-    - void.
+    - The coroutine.
 */
-void deposit(Bank* bank) {
-    try {
-        account_transaction_form(bank, false);
-        end_action("Record Updated.\n");
-    } catch (AccountNotFoundException &e) {
-        end_action("Could not find the requested account.\n");
+ServerTask accept_clients(BankServer* server) {
+    while (true) {
+        int client = accept4(server->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client >= 0) {
+            serve_client(server, client);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            co_await server->reactor->ready(server->listener, EPOLLIN);
+        } else if (errno != EINTR && errno != ECONNABORTED) {
+            this_thread::sleep_for(chrono::milliseconds(FOLLOW_POLL_MS));
+        }
     }
 }
 
 /*
-Performs a withdraw into the requested bank account. Will
-querry the user to get the account details, and the amount
-to deposit. If no account is found, no operation is performed.
+Serves a savefile to clients connecting to a Unix socket. Clients send
+one command per line (see execute_command, plus "save" to save the
+bank) and get one reply per line. Changes are journalled to the
+savefile's journal, which is replayed on start and emptied on save.
+The journal's header names the savefile it follows, so a journal
+left behind by a save that replaced the savefile but crashed before
+emptying the journal is not replayed a second time. After a replay
+the bank is saved and the journal emptied.
+Deposits into hot accounts only share the bank's lock, so they run
+on every thread at once.
 Params:
-    - bank: pointer to the main bank object.
+    - argc: number of input arguments
+    - argv: for the arguments
+    - hotAccounts: comma separated numbers of the hot accounts, or empty
 Returns:
-    - void.
+    - Exit status of the program.
 */
-void withdraw(Bank* bank) {
-    try {
-        account_transaction_form(bank, true);
-        end_action("Record updated.\n");
-    } catch (AccountNotFoundException &e) {
-        end_action("Could not find the account requested\n");
+int run_serve(int argc, char** argv, string hotAccounts) {
+    if (argc != 4) {
+        print_usage();
+    }
+    BankServer server;
+    server.savefile = argv[3];
+    server.bank = load_bank(server.savefile);
+    mark_hot_accounts(server.bank, hotAccounts);
+    string journalName = server.savefile + JOURNAL_SUFFIX;
+    ifstream replay(journalName);
+    string line;
+    bool replayed = false;
+    bool stale = false;
+    while (!stale && getline(replay, line)) {
+        if (line.compare(0, strlen(JOURNAL_HEADER), JOURNAL_HEADER) == 0) {
+            stale = line.compare(journal_header(server.savefile)) != 0;
+            continue;
+        }
+        vector<string> words = split_command(line);
+        if (!words.empty()) {
+            execute_command(server.bank, words);
+            replayed = true;
+        }
+    }
+    replay.close();
+    if (replayed && !save_bank(server.bank, server.savefile)) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
+    }
+    int journalFile = open(journalName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[2], sizeof(address.sun_path) - 1);
+    unlink(argv[2]);
+    server.listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (journalFile < 0 || server.listener < 0 ||
+            bind(server.listener, (sockaddr*) &address, sizeof(address)) != 0 ||
+            listen(server.listener, SERVER_BACKLOG) != 0) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    ServerExecutor executor(SERVER_THREADS);
+    ServerReactor reactor(&executor);
+    CommandJournal journal(journalFile, &executor);
+    journal.clear(journal_header(server.savefile));
+    server.executor = &executor;
+    server.reactor = &reactor;
+    server.journal = &journal;
+    cout << "Serving " << server.bank->name << " on " << argv[2] << endl;
+    accept_clients(&server);
+    while (true) {
+        pause();
     }
 }
 
 /*
-Performs the balance enquiry operation for the banking system.
-Displays all information of the requested account to the terminal.
-If no account is found, no operation is performed.
+Runs one line of a commands file against a sharded bank, routing it
+to the shard owning the account. Commands are:
+    deposit number amount
+    withdraw number amount
+    balance number
+    close number
+    transfer from to amount
 Params:
-    - bank: pointer to the main bank object
+    - bank: the sharded bank
+    - words: the command and its arguments
 Returns:
-    - void
+    - The text to print for the command, or the error.
 */
-void balance_enquiry(Bank* bank) {
-    cout << "Balance Details.\n";
-    int accNum = run_question_sequence("Enter the account number: ", 
-            convert_string_to_int);
+string run_sharded_command(ShardedBank& bank, const vector<string>& words) {
+    const string& name = words.at(0);
+    size_t numberOfWords = words.size();
     try {
-        bank->get_account(accNum)->display_account();
-    } catch (AccountNotFoundException &e) {
-        end_action("The account " + to_string(accNum) + " does not exist\n");
-        return;
+        int accNum = numberOfWords > 1 ? convert_string_to_int(words.at(1)) : -1;
+        float amount = numberOfWords > 2 ? convert_string_to_float(words.at(2)) : -1;
+        if (name.compare("deposit") == 0 && numberOfWords == 3 && accNum > 0 && amount >= 0) {
+            return to_string(accNum) + " " + to_string(bank.deposit(accNum, amount).get());
+        } else if (name.compare("withdraw") == 0 && numberOfWords == 3 && accNum > 0 && amount >= 0) {
+            return to_string(accNum) + " " + to_string(bank.withdraw(accNum, amount).get());
+        } else if (name.compare("balance") == 0 && numberOfWords == 2 && accNum > 0) {
+            return to_string(accNum) + " " + to_string(bank.balance(accNum).get());
+        } else if (name.compare("close") == 0 && numberOfWords == 2 && accNum > 0) {
+            bank.delete_account(accNum).get();
+            return "Closed " + to_string(accNum);
+        } else if (name.compare("transfer") == 0 && numberOfWords == 4 && accNum > 0) {
+            int to = convert_string_to_int(words.at(2));
+            amount = convert_string_to_float(words.at(3));
+            if (to > 0 && amount >= 0) {
+                bank.transfer(accNum, to, amount);
+                return "Transferred " + to_string(amount) + " from " + to_string(accNum) +
+                        " to " + to_string(to);
+            }
+        }
+    } catch (std::exception &e) {
+        return e.what();
     }
-    end_action("");
+    return "Unknown command or bad arguments";
 }
 
 /*
-Displays the account information of all accounts to the terminal.
+Loads a savefile into a bank partitioned over the requested number
+of shards, optionally runs a file of commands against it (see
+run_sharded_command, one per line), then prints the number of
+accounts and total balance held by each shard and by the whole bank.
+If commands were run, the accounts are gathered back from the shards
+and saved to the savefile: each account's change in balance is made
+as one deposit or withdrawal, and closed accounts are closed, so the
+savefile's history and mutation log carry on from the commands.
 Params:
-    - bank: pointer to the main bank object
+    - argc: number of input arguments
+    - argv: for the arguments
 Returns:
-    - void
+    - Exit status of the program.
 */
-void account_holders(Bank* bank) {
-    cout << "----All Account Holders List----\n";
-    string banner = string(101, '=') + '\n';
-    cout << banner;
-    string header = "Acc. No" + string(25, ' ') + 
-            "Name" + string(25, ' ') + "Type" + string(25, ' ') + "Balance\n";
-    cout << header;
-    cout << banner;
-    string buffer = "";
-    vector<Account> accounts = bank->get_accounts();
-    int numOfAcc = bank->get_num_of_accounts();
-    for (int i = 0; i < numOfAcc; i++) {
-        Account* account = &accounts.at(i);
-        buffer = add_details_to_string(buffer, account);
-        cout << buffer << '\n';
-        buffer = "";
+int run_sharded_report(int argc, char** argv) {
+    if (argc != 4 && argc != 5) {
+        print_usage();
+    }
+    ifstream commands;
+    if (argc == 5) {
+        commands.open(argv[4]);
+        if (!commands) {
+            cerr << BAD_FILE << endl;
+            return CANNOT_OPEN_FILE;
+        }
+    }
+    int numberOfShards = convert_string_to_int(argv[2]);
+    if (numberOfShards <= 0) {
+        cerr << "Please enter a positive number of shards.\n";
+        return BAD_ARGS;
+    }
+    Bank* loaded = load_bank(argv[3]);
+    ShardedBank bank(loaded->name, numberOfShards);
+    vector<future<void>> pending;
+    for (int i = 0; i < loaded->get_num_of_accounts(); i++) {
+        Account* account = loaded->get_account_at(i);
+        pending.push_back(bank.add_account(account->get_acc_num(),
+                account->get_holder(), account->get_type(), account->get_balance()));
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+        pending.at(i).get();
+    }
+    string line;
+    while (getline(commands, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        vector<string> words = split_command(line);
+        if (!words.empty()) {
+            cout << run_sharded_command(bank, words) << '\n';
+        }
+    }
+    cout << bank.name << "\n";
+    cout << "Shard" << string(SHARD_REPORT_WIDTH - 5, ' ')
+         << "Accounts" << string(SHARD_REPORT_WIDTH - 8, ' ') << "Balance\n";
+    for (int i = 0; i < bank.get_num_of_shards(); i++) {
+        ShardReport report = bank.shard_report(i).get();
+        string shard = to_string(i);
+        string count = to_string(report.numberOfAccounts);
+        cout << shard << string(SHARD_REPORT_WIDTH - shard.size(), ' ')
+             << count << string(SHARD_REPORT_WIDTH - count.size(), ' ')
+             << to_string(report.totalBalance) << '\n';
+    }
+    ShardReport total = bank.report();
+    string count = to_string(total.numberOfAccounts);
+    cout << "Total" << string(SHARD_REPORT_WIDTH - 5, ' ')
+         << count << string(SHARD_REPORT_WIDTH - count.size(), ' ')
+         << to_string(total.totalBalance) << '\n';
+    if (argc == 5) {
+        unordered_map<int, Account::Balance> balances;
+        for (int i = 0; i < bank.get_num_of_shards(); i++) {
+            vector<Account> accounts = bank.shard_accounts(i).get();
+            for (size_t j = 0; j < accounts.size(); j++) {
+                balances[accounts[j].get_acc_num()] = accounts[j].get_balance();
+            }
+        }
+        vector<int> closed;
+        for (int i = 0; i < loaded->get_num_of_accounts(); i++) {
+            Account* account = loaded->get_account_at(i);
+            unordered_map<int, Account::Balance>::iterator found = balances.find(account->get_acc_num());
+            if (found == balances.end()) {
+                closed.push_back(account->get_acc_num());
+            } else if (found->second > account->get_balance()) {
+                loaded->deposit(account->get_acc_num(), found->second - account->get_balance());
+            } else if (found->second < account->get_balance()) {
+                loaded->withdraw(account->get_acc_num(), account->get_balance() - found->second);
+            }
+        }
+        for (size_t i = 0; i < closed.size(); i++) {
+            loaded->delete_account(closed[i]);
+        }
+        if (!save_bank(loaded, argv[3])) {
+            cerr << BAD_FILE << endl;
+            delete loaded;
+            return CANNOT_OPEN_FILE;
+        }
     }
+    delete loaded;
+    return NORMAL_EXIT;
 }
 
 /*
-Closes a bank account. Will querry the user and retrieve
-the account informaiton. If no account can be found then
-no operation is performed.
+Imports a CSV or JSON file of accounts and writes them to a savefile.
+The input is streamed twice: first to validate it with the same rules
+as a savefile and count the accounts, keeping only the set of account
+numbers seen to find duplicates, then to write each account straight
+to the savefile. No bank is built, so memory grows only with the set
+of account numbers. The bank is named after the input file.
 Params:
-    - bank: pointer to the main bank object
+    - argc: number of input arguments
+    - argv: for the arguments
 Returns:
-    - void
+    - Exit status of the program.
 */
-void close_account(Bank* bank) {
-    cout << "----Delete Record----\n";
-    int accNum = run_question_sequence("Enter the account number: ", 
-            convert_string_to_int);
-    try {
-        bank->delete_account(accNum);
-        end_action("Record Deleted\n");
-    } catch (AccountNotFoundException &e) {
-        cerr << "Account " << accNum << " does not exist." << endl;
-        end_action("");
+int run_import(int argc, char** argv) {
+    if (argc != 4) {
+        print_usage();
+    }
+    string extension = file_extension(argv[2]);
+    if (extension.compare(".csv") != 0 && extension.compare(".json") != 0) {
+        cerr << "Imports must be .csv or .json files\n";
+        return BAD_ARGS;
+    }
+    unique_ptr<RecordReader> reader(open_record_reader(argv[2]));
+    if (!reader) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
+    }
+    unordered_set<int> numbers;
+    numbers.reserve(filesystem::file_size(argv[2]) / IMPORT_BYTES_PER_RECORD);
+    AccountRecord record;
+    while (reader->next(&record)) {
+        if (!numbers.insert(record.accNum).second) {
+            cerr << AccountAlreadyExistsException().what() << " (record " << reader->recordNumber << ")\n";
+            return BAD_FILE_FORMAT;
+        }
+    }
+    if (reader->failed) {
+        cerr << BAD_FORMAT << " (record " << reader->recordNumber + 1 << ")\n";
+        return BAD_FILE_FORMAT;
+    }
+    size_t numOfAcc = numbers.size();
+    numbers = unordered_set<int>();
+    reader.reset(open_record_reader(argv[2]));
+    string outName = string(argv[3]) + TEMP_SUFFIX;
+    ofstream saveFile(outName);
+    if (!reader || !saveFile) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
+    }
+    saveFile << filesystem::path(argv[2]).stem().string() << '\n' << numOfAcc << '\n'
+             << ACCOUNT_SEP_LINE << '\n';
+    for (size_t i = 0; reader->next(&record); i++) {
+        if (i > 0) {
+            saveFile << ACCOUNT_SEP_LINE << '\n';
+        }
+        saveFile << Account(record.accNum, record.holder, record.type, record.balance).account_string();
+    }
+    saveFile << "END";
+    saveFile.close();
+    if (!saveFile) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
     }
+    filesystem::rename(outName, argv[3]);
+    filesystem::remove_all(string(argv[3]) + HISTORY_SUFFIX);
+    filesystem::remove_all(string(argv[3]) + MUTATION_SUFFIX);
+    cout << "Imported " << numOfAcc << " accounts\n";
+    return NORMAL_EXIT;
 }
 
 /*
-Modifies an existing bank account. All details (account no., 
-holder, type, balance) are requested from the user. If no account 
-is found, no operation is performed.
+Exports a savefile or snapshot to a CSV or JSON file. Both files are streamed,
+so savefiles of any size are exported in constant memory.
 Params:
-    - bank: pointer to the main bank object
+    - argc: number of input arguments
+    - argv: for the arguments
 Returns:
-    - void
+    - Exit status of the program.
 */
-void modify_account(Bank* bank) {
-    cout << "----Modify Record----\n";
-    int accNum = run_question_sequence("Enter the Account Number: ", 
-            convert_string_to_int);
-    Account* account;
-    try {
-        account = bank->get_account(accNum);
-    } catch (AccountNotFoundException &e) {
-        end_action("The account " + to_string(accNum) + " does not exist\n");
-        return;
+int run_export(int argc, char** argv) {
+    if (argc != 4) {
+        print_usage();
     }
-    account->display_account();;
-    int newAccNum = get_account_number(bank);
-    account->set_acc_number(newAccNum);
-    string newName = get_account_holder("Modify Account Holder Name: ");
-    account->set_name(newName);
-    string newAccType = get_type_of_account("Modify Type of Account: ");
-    account->set_acc_type(newAccType);
-    float newBalance = get_balance("Modify Balance Amount: ");
-    account->set_balance(newBalance);
-    end_action("Record Updated\n");
+    unique_ptr<RecordReader> reader(open_record_reader(argv[2]));
+    RecordWriter writer;
+    if (!reader || !writer.open(argv[3])) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
+    }
+    AccountRecord record;
+    while (reader->next(&record)) {
+        writer.write(record);
+    }
+    if (reader->failed) {
+        cerr << BAD_FORMAT << " (record " << reader->recordNumber + 1 << ")\n";
+        return BAD_FILE_FORMAT;
+    }
+    if (!writer.finish()) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
+    }
+    cout << "Exported " << reader->recordNumber << " accounts\n";
+    return NORMAL_EXIT;
 }
 
 /*
-Quits the program when requested from the user in the main menu.
+A single difference found between two savefiles.
+*/
+struct AccountDiff {
+    /*'+' for an added account, '-' for a removed one, '~' for a changed one.*/
+    char kind;
+    /*The account in the first savefile (unused when added).*/
+    AccountRecord before;
+    /*The account in the second savefile (unused when removed).*/
+    AccountRecord after;
+};
+
+/*
+Reads every record of a savefile (or snapshot, CSV or JSON file) and
+splits them into partitions by account number, so each partition can
+be compared on its own.
 Params:
-    - bank: pointer to the main bank object
+    - fileName: name of the file to read
+    - partitions: set to the records of each partition
+    - totalBalance: set to the sum of the balances read
 Returns:
-    - void
+    - Exit status: NORMAL_EXIT, CANNOT_OPEN_FILE or BAD_FILE_FORMAT.
 */
-void quit_program(Bank* bank) {
-    cout << "Exiting...\n";
-    exit(NORMAL_EXIT);
+int partition_records(string fileName, vector<vector<AccountRecord>>* partitions,
+        double* totalBalance) {
+    RecordReader* reader = open_record_reader(fileName);
+    if (reader == NULL) {
+        return CANNOT_OPEN_FILE;
+    }
+    partitions->assign(DIFF_PARTITIONS, vector<AccountRecord>());
+    *totalBalance = 0;
+    AccountRecord record;
+    while (reader->next(&record)) {
+        unsigned int mixed = (unsigned int) record.accNum * 2654435761u;
+        (*partitions)[(mixed >> 16) % DIFF_PARTITIONS].push_back(record);
+        *totalBalance += record.balance;
+    }
+    int status = reader->failed ? BAD_FILE_FORMAT : NORMAL_EXIT;
+    delete reader;
+    return status;
 }
 
 /*
-When requested by the user in the main menu, this function saves
-the status of the bank into a text file requested by the user.
+Compares one partition of two savefiles with a sorted merge.
 Params:
-    - bank: pointer to the main bank object
+    - before: records of the partition in the first savefile
+    - after: records of the partition in the second savefile
+    - diffs: set to the differences found, sorted by account number
 Returns:
     - void
 */
-void save(Bank* bank) {
-    cout << "----Save Bank Status-----\n";
-    cout << "Enter the name of the file: ";
-    string fileName = get_user_input();
-    ofstream saveFile;
-    saveFile.open(fileName);
-    if (!saveFile) {
-        cerr << BAD_FILE << endl;
-        exit(CANNOT_OPEN_FILE);
-    }
-    saveFile << bank->name << endl;
-    saveFile << bank->get_num_of_accounts() << endl;
-    saveFile << ACCOUNT_SEP_LINE << endl;
-    int numOfAcc = bank->get_num_of_accounts();
-    vector<Account> accounts = bank->get_accounts();
-    for (int i = 0; i < numOfAcc; i++) {
-        saveFile << accounts.at(i).account_string();
-        if (i != numOfAcc - 1) {
-            saveFile << ACCOUNT_SEP_LINE << endl;
+void diff_partition(vector<AccountRecord>& before, vector<AccountRecord>& after,
+        vector<AccountDiff>* diffs) {
+    function<bool(const AccountRecord&, const AccountRecord&)> byNumber =
+            [](const AccountRecord& a, const AccountRecord& b) { return a.accNum < b.accNum; };
+    sort(before.begin(), before.end(), byNumber);
+    sort(after.begin(), after.end(), byNumber);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < before.size() || j < after.size()) {
+        AccountDiff diff;
+        if (j == after.size() || (i < before.size() && before[i].accNum < after[j].accNum)) {
+            diff.kind = '-';
+            diff.before = before[i++];
+        } else if (i == before.size() || after[j].accNum < before[i].accNum) {
+            diff.kind = '+';
+            diff.after = after[j++];
+        } else {
+            if (before[i].holder == after[j].holder && before[i].type == after[j].type &&
+                    before[i].balance == after[j].balance) {
+                i++;
+                j++;
+                continue;
+            }
+            diff.kind = '~';
+            diff.before = before[i++];
+            diff.after = after[j++];
         }
+        diffs->push_back(diff);
     }
-    saveFile << "END";
-    saveFile.close();
 }
 
 /*
-Function to handle the request from the user
+Applies a CSV file of postings (columns id, number, amount; negative
+amounts are withdrawals) to a savefile. The IDs of applied postings
+are kept next to the savefile, so postings already applied, e.g. by
+an earlier run of a retried batch, are skipped. Postings are applied
+POST_BATCH_SIZE at a time with Bank::post_batch. The new IDs are
+written to a temporary file before the savefile is replaced, and only
+take the place of the old IDs once it has been, so after a crash the
+IDs always match the savefile (a leftover temporary file is finished
+or discarded on the next run).
 Params:
-    - inputNum: number which the user has selected
-    - bank: pointer to the main bank object
+    - argc: number of input arguments
+    - argv: for the arguments
 Returns:
-    - void
+    - Exit status of the program.
 */
-void handle_input(int inputNum, Bank* bank) {
-    switch (inputNum) {
-        case 1: new_account(bank, "----New Account Entry Form----\n"); break;
-        case 2: deposit(bank); break;
-        case 3: withdraw(bank); break;
-        case 4: balance_enquiry(bank); break;
-        case 5: account_holders(bank); break;
-        case 6: close_account(bank); break;
-        case 7: modify_account(bank); break;
-        case 8: quit_program(bank); break;
-        case 9: save(bank); break;
+int run_post(int argc, char** argv) {
+    if (argc != 4) {
+        print_usage();
+    }
+    ifstream postings(argv[2]);
+    if (!postings) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
+    }
+    string idsFileName = string(argv[3]) + TXID_FILE_SUFFIX;
+    if (filesystem::exists(idsFileName + TEMP_SUFFIX)) {
+        if (filesystem::exists(string(argv[3]) + TEMP_SUFFIX)) {
+            filesystem::remove(idsFileName + TEMP_SUFFIX);
+        } else {
+            filesystem::rename(idsFileName + TEMP_SUFFIX, idsFileName);
+        }
+    }
+    Bank* bank = load_bank(argv[3]);
+    bank->get_transaction_ids().load(idsFileName);
+    long long counts[BATCH_DUPLICATE + 1] = {};
+    long long lineNumber = 0;
+    vector<string> ids;
+    vector<int> numbers;
+    vector<Account::Balance> amounts;
+    vector<long long> lineNumbers;
+    vector<int> statuses(POST_BATCH_SIZE);
+    string line;
+    bool more = true;
+    while (more) {
+        more = (bool) getline(postings, line);
+        if (more) {
+            lineNumber++;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty() || (lineNumber == 1 && line.compare(POSTINGS_HEADER) == 0)) {
+                continue;
+            }
+            size_t first = line.find(',');
+            size_t second = first == string::npos ? string::npos : line.find(',', first + 1);
+            if (first == 0 || second == string::npos) {
+                cerr << BAD_FORMAT << " (line " << lineNumber << ")\n";
+                return BAD_FILE_FORMAT;
+            }
+            int accNum = convert_string_to_int(line.substr(first + 1, second - first - 1));
+            bool negative = line.compare(second + 1, 1, "-") == 0;
+            float amount = convert_string_to_float(line.substr(second + 1 + negative));
+            if (accNum < 0 || amount < 0) {
+                cerr << BAD_FORMAT << " (line " << lineNumber << ")\n";
+                return BAD_FILE_FORMAT;
+            }
+            ids.push_back(line.substr(0, first));
+            numbers.push_back(accNum);
+            amounts.push_back(negative ? -amount : amount);
+            lineNumbers.push_back(lineNumber);
+            if (ids.size() < POST_BATCH_SIZE) {
+                continue;
+            }
+        }
+        bank->post_batch(ids.data(), numbers.data(), amounts.data(), ids.size(), statuses.data());
+        for (size_t i = 0; i < ids.size(); i++) {
+            counts[statuses[i]]++;
+            if (statuses[i] == BATCH_NOT_FOUND) {
+                cerr << AccountNotFoundException().what() << " (line " << lineNumbers[i] << ")\n";
+            } else if (statuses[i] == BATCH_NEGATIVE_BALANCE) {
+                cerr << NegativeBalanceException().what() << " (line " << lineNumbers[i] << ")\n";
+            }
+        }
+        ids.clear();
+        numbers.clear();
+        amounts.clear();
+        lineNumbers.clear();
+    }
+    if (!bank->get_transaction_ids().save(idsFileName + TEMP_SUFFIX) || !save_bank(bank, argv[3])) {
+        cerr << BAD_FILE << endl;
+        return CANNOT_OPEN_FILE;
     }
+    filesystem::rename(idsFileName + TEMP_SUFFIX, idsFileName);
+    cout << "Applied " << counts[BATCH_OK] << " postings, skipped " << counts[BATCH_DUPLICATE]
+         << " duplicates, " << counts[BATCH_NOT_FOUND] + counts[BATCH_NEGATIVE_BALANCE] << " failed\n";
+    delete bank;
+    return NORMAL_EXIT;
 }
 
 /*
-Performs the main menu operation for the banking system.
-Will display the options then querry the user for their
-selection. It will then go onto to execute that operation.
+Compares two savefiles and prints the accounts added, removed and
+changed, followed by a summary and the drift in the total balance.
+Both files are read at the same time, split into partitions by
+account number, and the partitions are compared in parallel.
 Params:
-    - bank: pointer to the main bank object
+    - argc: number of input arguments
+    - argv: for the arguments
 Returns:
-    - void
+    - Exit status of the program.
 */
-void run_bank(Bank* bank) {
-    string mainMenu = "Main Menu:\n1. New Account\n2. Deposit Amount\n3. \
-Withdraw Amount\n4. Balance Enquiry\n5. All Account Holders List\n6. Close \
-An Account\n7. Modify An Account\n8. Exit\n9. Save Bank Status\nSelect your \
-option (1-8)\n";
-    string errMessage = "Please enter a number between 1 to 9\n";
-    string input;
-    int inputNum;
-    while (true) {
-        cout << bank->name << "\n";
-        cout << mainMenu;
-        getline(cin, input);
-        inputNum = convert_string_to_int(input);
-        if (inputNum < 1 || inputNum > 9) {
-            cout << errMessage;
+int run_diff(int argc, char** argv) {
+    if (argc != 4) {
+        print_usage();
+    }
+    vector<vector<AccountRecord>> before, after;
+    double totalBefore, totalAfter;
+    int statusBefore;
+    thread readBefore([&]() {
+        statusBefore = partition_records(argv[2], &before, &totalBefore);
+    });
+    int statusAfter = partition_records(argv[3], &after, &totalAfter);
+    readBefore.join();
+    if (statusBefore != NORMAL_EXIT || statusAfter != NORMAL_EXIT) {
+        int status = max(statusBefore, statusAfter);
+        cerr << (status == CANNOT_OPEN_FILE ? BAD_FILE : BAD_FORMAT) << endl;
+        return status;
+    }
+    vector<vector<AccountDiff>> diffs(DIFF_PARTITIONS);
+    parallel_for_chunks(DIFF_PARTITIONS, 1, [&](size_t begin, size_t) {
+        diff_partition(before[begin], after[begin], &diffs[begin]);
+        vector<AccountRecord>().swap(before[begin]);
+        vector<AccountRecord>().swap(after[begin]);
+    });
+    vector<AccountDiff*> ordered;
+    for (size_t p = 0; p < diffs.size(); p++) {
+        for (size_t i = 0; i < diffs[p].size(); i++) {
+            ordered.push_back(&diffs[p][i]);
+        }
+    }
+    sort(ordered.begin(), ordered.end(), [](AccountDiff* a, AccountDiff* b) {
+        int first = a->kind == '+' ? a->after.accNum : a->before.accNum;
+        int second = b->kind == '+' ? b->after.accNum : b->before.accNum;
+        return first < second;
+    });
+    int added = 0, removed = 0, changed = 0;
+    double changedDrift = 0;
+    string buffer;
+    for (size_t i = 0; i < ordered.size(); i++) {
+        AccountDiff* diff = ordered[i];
+        if (diff->kind == '+') {
+            added++;
+            buffer += "+ " + to_string(diff->after.accNum) + ' ' + diff->after.holder + ' ' +
+                    diff->after.type + ' ' + to_string(diff->after.balance) + '\n';
+        } else if (diff->kind == '-') {
+            removed++;
+            buffer += "- " + to_string(diff->before.accNum) + ' ' + diff->before.holder + ' ' +
+                    diff->before.type + ' ' + to_string(diff->before.balance) + '\n';
+        } else {
+            changed++;
+            changedDrift += (double) diff->after.balance - diff->before.balance;
+            buffer += "~ " + to_string(diff->before.accNum);
+            if (diff->before.holder != diff->after.holder) {
+                buffer += " holder: " + diff->before.holder + " -> " + diff->after.holder;
+            }
+            if (diff->before.type != diff->after.type) {
+                buffer += " type: " + diff->before.type + " -> " + diff->after.type;
+            }
+            if (diff->before.balance != diff->after.balance) {
+                buffer += " balance: " + to_string(diff->before.balance) + " -> " +
+                        to_string(diff->after.balance);
+            }
+            buffer += '\n';
+        }
+        if (buffer.size() >= (1 << 20)) {
+            cout << buffer;
+            buffer.clear();
         }
-        handle_input(inputNum, bank);
     }
+    cout << buffer;
+    cout << "Added: " << added << ", Removed: " << removed << ", Changed: " << changed << '\n';
+    cout << "Total balance: " << to_string(totalBefore) << " -> " << to_string(totalAfter)
+         << " (drift " << to_string(totalAfter - totalBefore) << ", of which "
+         << to_string(changedDrift) << " from changed accounts)\n";
+    return NORMAL_EXIT;
 }
 
 int main(int argc, char** argv) {
+    static CdcPublisher publisher;
+    bool publishing = false;
+    bool journaling = false;
+    string hotAccounts;
+    while (argc > 2) {
+        string option = argv[1];
+        if ((option.compare("--cdc") == 0 || option.compare("--journal") == 0) && !publishing) {
+            publishing = true;
+            journaling = option.compare("--journal") == 0;
+            if (!publisher.start(argv[2], journaling)) {
+                cerr << BAD_FILE << endl;
+                return CANNOT_OPEN_FILE;
+            }
+        } else if (option.compare("--hot") == 0 && hotAccounts.empty()) {
+            hotAccounts = argv[2];
+        } else {
+            break;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc > 1) {
+        string mode = argv[1];
+        if (mode.compare("--shards") == 0) {
+            return run_sharded_report(argc, argv);
+        } else if (mode.compare("--import") == 0) {
+            return run_import(argc, argv);
+        } else if (mode.compare("--export") == 0) {
+            return run_export(argc, argv);
+        } else if (mode.compare("--diff") == 0) {
+            return run_diff(argc, argv);
+        } else if (mode.compare("--post") == 0) {
+            return run_post(argc, argv);
+        } else if (mode.compare("--serve") == 0) {
+            return run_serve(argc, argv, hotAccounts);
+        } else if (mode.compare("--script") == 0) {
+            return run_script(argc, argv);
+        } else if (mode.compare("--lazy") == 0 && argc == 3) {
+            Bank* bank = open_lazy_bank(argv[2]);
+            mark_hot_accounts(bank, hotAccounts);
+            bank->attach_cdc(publishing ? &publisher : NULL, journaling);
+            run_bank(bank);
+        } else if (mode.compare("--follow") == 0 && argc == 3) {
+            run_follower(new Follower(argv[2]));
+        } else if (mode.compare(0, 2, "--") == 0) {
+            print_usage();
+        }
+    }
     check_args(argc);
     Bank* bank;
     bank = create_bank(argc, argv);
+    mark_hot_accounts(bank, hotAccounts);
+    bank->attach_cdc(publishing ? &publisher : NULL, journaling);
     run_bank(bank);
     return NORMAL_EXIT;
 }
\ No newline at end of file
@@ -0,0 +1,648 @@
+/*
+Tests of the files a bank keeps on disk: the savefile and snapshot
+formats, the transaction history, the mutation log, transaction IDs,
+the change feed journal and the server's command journal. Each format
+is saved and loaded back, and where the program relies on a file being
+replaced last to survive a crash, the files a crash at that point would
+leave behind are put in place and loaded.
+
+Build and run with make test. Files are written to a directory under
+the system's temporary directory, which is removed on success.
+*/
+#define main bank_main
+#include "../bank.cpp"
+#undef main
+#include <map>
+#include <sys/wait.h>
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+#define SERVER_START_MS 5000
+#define REPLICA_WAIT_MS 5000
+
+/*Number of checks that failed.*/
+int failures = 0;
+/*Directory the tests write their files to.*/
+string testDirectory;
+
+/*
+Records the result of a check, printing it if it failed.
+Params:
+    - ok: result of the check
+    - text: the condition checked
+    - line: line of the check
+Returns:
+    - void
+*/
+void check(bool ok, const char* text, int line) {
+    if (!ok) {
+        cerr << "line " << line << ": CHECK(" << text << ") failed\n";
+        failures++;
+    }
+}
+
+/*
+Function to name a file in the test directory.
+Params:
+    - name: name of the file
+Returns:
+    - The path of the file.
+*/
+string test_file(string name) {
+    return (filesystem::path(testDirectory) / name).string();
+}
+
+/*
+Function to make the bank most of the tests start from.
+Params:
+    - void
+Returns:
+    - Pointer to the bank.
+*/
+Bank* sample_bank(void) {
+    Bank* bank = new Bank("Test Bank");
+    bank->add_account(1001, "Alice Smith", "S", 500);
+    bank->add_account(1002, "Bob Jones", "C", 120.5);
+    bank->add_account(1003, "Carol", "S", 75.25);
+    return bank;
+}
+
+/*
+Function to copy the details of every account of a bank.
+Params:
+    - bank: the bank
+Returns:
+    - The accounts' records, by account number.
+*/
+map<int, AccountRecord> bank_records(Bank* bank) {
+    map<int, AccountRecord> records;
+    bank->for_each_account([&](Account& account) {
+        records[account.get_acc_num()] = account_record(&account);
+    });
+    return records;
+}
+
+/*
+Function to compare the records of two banks.
+Params:
+    - first: records of one bank
+    - second: records of the other bank
+Returns:
+    - bool true if both hold the same accounts with the same details.
+*/
+bool same_records(map<int, AccountRecord>& first, map<int, AccountRecord>& second) {
+    if (first.size() != second.size()) {
+        return false;
+    }
+    for (pair<const int, AccountRecord>& entry : first) {
+        map<int, AccountRecord>::iterator other = second.find(entry.first);
+        if (other == second.end() || entry.second.holder != other->second.holder ||
+                entry.second.type != other->second.type ||
+                entry.second.balance != other->second.balance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Function to compare two lists of transactions.
+Params:
+    - first: one list
+    - second: the other list
+Returns:
+    - bool true if both hold the same transactions in the same order.
+*/
+bool same_transactions(vector<Transaction>& first, vector<Transaction>& second) {
+    if (first.size() != second.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < first.size(); i++) {
+        if (first[i].timestamp != second[i].timestamp || first[i].accNum != second[i].accNum ||
+                first[i].kind != second[i].kind || first[i].amount != second[i].amount ||
+                first[i].balance != second[i].balance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Function to find the differences between two files, as --diff does.
+Params:
+    - before: name of the first file
+    - after: name of the second file
+    - status: set to the worst status of reading either file
+Returns:
+    - The differences found.
+*/
+vector<AccountDiff> diff_files(string before, string after, int* status) {
+    vector<vector<AccountRecord>> beforePartitions, afterPartitions;
+    double beforeTotal, afterTotal;
+    *status = max(partition_records(before, &beforePartitions, &beforeTotal),
+            partition_records(after, &afterPartitions, &afterTotal));
+    vector<AccountDiff> diffs;
+    if (*status != NORMAL_EXIT) {
+        return diffs;
+    }
+    for (size_t p = 0; p < DIFF_PARTITIONS; p++) {
+        diff_partition(beforePartitions[p], afterPartitions[p], &diffs);
+    }
+    return diffs;
+}
+
+/*
+Function to keep checking a condition until it holds or time runs out.
+Params:
+    - condition: the condition
+    - milliseconds: how long to wait
+Returns:
+    - bool true if the condition came to hold.
+*/
+bool wait_until(function<bool()> condition, int milliseconds) {
+    for (int waited = 0; waited < milliseconds; waited += FOLLOW_POLL_MS) {
+        if (condition()) {
+            return true;
+        }
+        this_thread::sleep_for(chrono::milliseconds(FOLLOW_POLL_MS));
+    }
+    return condition();
+}
+
+/*
+Function to run a mode of the program with the given arguments.
+Params:
+    - mode: the function running the mode
+    - args: the arguments, starting with the program name
+Returns:
+    - Exit status of the mode.
+*/
+int run_mode(function<int(int, char**)> mode, vector<string> args) {
+    vector<char*> argv;
+    for (size_t i = 0; i < args.size(); i++) {
+        argv.push_back(&args[i][0]);
+    }
+    argv.push_back(NULL);
+    return mode(args.size(), argv.data());
+}
+
+/*
+Function to start serving a savefile in a child process.
+Params:
+    - socketPath: path of the socket to serve on
+    - savefile: name of the savefile
+Returns:
+    - The process ID of the server.
+*/
+pid_t start_server(string socketPath, string savefile) {
+    pid_t child = fork();
+    if (child == 0) {
+        freopen("/dev/null", "w", stdout);
+        _exit(run_mode([](int argc, char** argv) { return run_serve(argc, argv, ""); },
+                {"bank", "--serve", socketPath, savefile}));
+    }
+    return child;
+}
+
+/*
+Function to kill a server without letting it save or clean up, as
+a crash would.
+Params:
+    - server: the process ID of the server
+Returns:
+    - void
+*/
+void crash_server(pid_t server) {
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+}
+
+/*
+Function to send commands to a server and read its replies. Waits
+for the server to start accepting clients first.
+Params:
+    - socketPath: path of the server's socket
+    - commands: the commands, one per line
+    - numberOfReplies: number of reply lines to wait for
+Returns:
+    - The replies, or an empty string if the server could not be reached.
+*/
+string ask_server(string socketPath, string commands, int numberOfReplies) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    int client = -1;
+    bool connected = wait_until([&]() {
+        client = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(client, (sockaddr*) &address, sizeof(address)) == 0) {
+            return true;
+        }
+        close(client);
+        return false;
+    }, SERVER_START_MS);
+    if (!connected) {
+        return "";
+    }
+    string replies;
+    if (write(client, commands.data(), commands.size()) == (ssize_t) commands.size()) {
+        char buffer[SERVER_READ_SIZE];
+        ssize_t length;
+        while (count(replies.begin(), replies.end(), '\n') < numberOfReplies &&
+                (length = read(client, buffer, sizeof(buffer))) > 0) {
+            replies.append(buffer, length);
+        }
+    }
+    close(client);
+    return replies;
+}
+
+/*
+Changes made through the server are journalled before they are
+acknowledged, replayed into the savefile by the next server after a
+crash, and not replayed again once saved. A journal left over from
+another savefile is ignored.
+*/
+void test_server_journal(void) {
+    string savefile = test_file("served.txt");
+    string socketPath = test_file("served.sock");
+    Bank* bank = sample_bank();
+    CHECK(save_bank(bank, savefile));
+    delete bank;
+
+    pid_t server = start_server(socketPath, savefile);
+    string replies = ask_server(socketPath, "deposit 1001 5\nwithdraw 1002 0.5\n", 2);
+    crash_server(server);
+    CHECK(replies.compare("OK\t1001\tAlice Smith\tS\t505.000000\n"
+            "OK\t1002\tBob Jones\tC\t120.000000\n") == 0);
+
+    server = start_server(socketPath, savefile);
+    replies = ask_server(socketPath, "show 1001\n", 1);
+    crash_server(server);
+    CHECK(replies.compare("OK\t1001\tAlice Smith\tS\t505.000000\n") == 0);
+    bank = load_bank(savefile);
+    CHECK(bank->get_account(1001)->get_balance() == 505);
+    CHECK(bank->get_account(1002)->get_balance() == 120);
+    delete bank;
+
+    server = start_server(socketPath, savefile);
+    replies = ask_server(socketPath, "show 1001\n", 1);
+    crash_server(server);
+    CHECK(replies.compare("OK\t1001\tAlice Smith\tS\t505.000000\n") == 0);
+
+    ofstream journal(savefile + JOURNAL_SUFFIX);
+    journal << JOURNAL_HEADER << " another-savefile\ndeposit 1001 100\n";
+    journal.close();
+    server = start_server(socketPath, savefile);
+    replies = ask_server(socketPath, "show 1001\n", 1);
+    crash_server(server);
+    CHECK(replies.compare("OK\t1001\tAlice Smith\tS\t505.000000\n") == 0);
+}
+
+/*
+Deposits and withdrawals are found in the statement of a bank loaded
+from the savefile, and the history keeps growing from there.
+*/
+void test_history_round_trip(void) {
+    string savefile = test_file("history.txt");
+    Bank* bank = sample_bank();
+    for (int i = 0; i < HISTORY_SEGMENT_SIZE + 10; i++) {
+        bank->deposit(1001, 1);
+    }
+    bank->withdraw(1002, 20);
+    vector<Transaction> alice = bank->statement(1001, HISTORY_SEGMENT_SIZE * 2);
+    vector<Transaction> bob = bank->statement(1002, 10);
+    CHECK(alice.size() == HISTORY_SEGMENT_SIZE + 10);
+    CHECK(save_bank(bank, savefile));
+    delete bank;
+
+    bank = load_bank(savefile);
+    vector<Transaction> loadedAlice = bank->statement(1001, HISTORY_SEGMENT_SIZE * 2);
+    vector<Transaction> loadedBob = bank->statement(1002, 10);
+    CHECK(same_transactions(alice, loadedAlice));
+    CHECK(same_transactions(bob, loadedBob));
+    CHECK(bank->statement(1003, 10).empty());
+    bank->deposit(1003, 5);
+    CHECK(save_bank(bank, savefile));
+    delete bank;
+
+    bank = load_bank(savefile);
+    CHECK(bank->statement(1001, HISTORY_SEGMENT_SIZE * 2).size() == HISTORY_SEGMENT_SIZE + 10);
+    CHECK(bank->statement(1003, 10).size() == 1);
+    delete bank;
+}
+
+/*
+A crash after the history's segments are written but before its index
+is replaced leaves segments holding more entries than the index names.
+Only the entries the index names are loaded.
+*/
+void test_history_crash_before_index(void) {
+    string savefile = test_file("history-crash.txt");
+    string index = savefile + HISTORY_SUFFIX + "/" + HISTORY_INDEX;
+    Bank* bank = sample_bank();
+    bank->deposit(1001, 1);
+    bank->deposit(1001, 2);
+    CHECK(save_bank(bank, savefile));
+    filesystem::copy_file(index, index + ".saved");
+    bank->deposit(1001, 3);
+    CHECK(save_bank(bank, savefile));
+    delete bank;
+    filesystem::rename(index + ".saved", index);
+
+    bank = load_bank(savefile);
+    vector<Transaction> entries = bank->statement(1001, 10);
+    CHECK(entries.size() == 2);
+    bank->deposit(1002, 4);
+    entries = bank->statement(1002, 10);
+    CHECK(entries.size() == 1 && entries[0].amount == 4);
+    CHECK(bank->statement(1001, 10).size() == 2);
+    delete bank;
+}
+
+/*
+Balances at past times can be queried in a bank loaded from the
+savefile, both from before and after a checkpoint.
+*/
+void test_mutation_log_round_trip(void) {
+    string savefile = test_file("mutations.txt");
+    Bank* bank = sample_bank();
+    this_thread::sleep_for(chrono::milliseconds(2));
+    long long opened = current_time();
+    this_thread::sleep_for(chrono::milliseconds(2));
+    for (int i = 0; i < CHECKPOINT_INTERVAL + 10; i++) {
+        bank->deposit(1002, 1);
+    }
+    this_thread::sleep_for(chrono::milliseconds(2));
+    long long deposited = current_time();
+    this_thread::sleep_for(chrono::milliseconds(2));
+    bank->delete_account(1003);
+    CHECK(save_bank(bank, savefile));
+    delete bank;
+
+    bank = load_bank(savefile);
+    Account::Balance balance = 0;
+    CHECK(bank->balance_at(1002, opened, &balance) && balance == 120.5);
+    CHECK(bank->balance_at(1002, deposited, &balance) && balance == 120.5 + CHECKPOINT_INTERVAL + 10);
+    CHECK(bank->balance_at(1003, deposited, &balance) && balance == 75.25);
+    CHECK(!bank->balance_at(1003, current_time(), &balance));
+    CHECK(bank->total_at(opened) == 500 + 120.5 + 75.25);
+    bank->deposit(1001, 10);
+    CHECK(save_bank(bank, savefile));
+    delete bank;
+
+    bank = load_bank(savefile);
+    CHECK(bank->balance_at(1002, opened, &balance) && balance == 120.5);
+    CHECK(bank->balance_at(1001, current_time(), &balance) && balance == 510);
+    delete bank;
+}
+
+/*
+A crash after the mutation log is saved but before the savefile is
+replaced leaves a log ending in accounts other than the savefile's.
+That log is not loaded, and a new one starts from the savefile.
+*/
+void test_mutation_log_stale(void) {
+    string savefile = test_file("mutations-crash.txt");
+    Bank* bank = sample_bank();
+    CHECK(save_bank(bank, savefile));
+    filesystem::copy_file(savefile, savefile + ".saved");
+    bank->deposit(1001, 50);
+    CHECK(save_bank(bank, savefile));
+    delete bank;
+    filesystem::rename(savefile + ".saved", savefile);
+
+    bank = load_bank(savefile);
+    Account::Balance balance = 0;
+    CHECK(bank->balance_at(1001, current_time(), &balance) && balance == 500);
+    CHECK(bank->total_at(current_time()) == 500 + 120.5 + 75.25);
+    delete bank;
+}
+
+/*
+A snapshot holds exactly the accounts of the savefile it was made
+from, and a damaged block is found when decoded.
+*/
+void test_snapshot_round_trip(void) {
+    string savefile = test_file("snapshot.txt");
+    string snapshot = test_file("snapshot.snap");
+    Bank* bank = sample_bank();
+    bank->add_account(1004, "Dan Brown", "C", 0.01);
+    bank->add_account(2000000, "Eve", "S", 99999.99);
+    for (int i = 0; i < SNAPSHOT_BLOCK_SIZE; i++) {
+        bank->add_account(10000 + i * 7, "Many Holders", i % 2 == 0 ? "S" : "C", 1 + i * 0.37);
+    }
+    map<int, AccountRecord> records = bank_records(bank);
+    CHECK(save_bank(bank, savefile));
+    CHECK(save_bank(bank, snapshot));
+    delete bank;
+
+    bank = load_bank(snapshot);
+    map<int, AccountRecord> loaded = bank_records(bank);
+    CHECK(same_records(records, loaded));
+    CHECK(bank->name.compare("Test Bank") == 0);
+    delete bank;
+
+    vector<AccountRecord> block;
+    for (map<int, AccountRecord>::iterator it = records.begin();
+            it != records.end() && block.size() < SNAPSHOT_BLOCK_SIZE; it++) {
+        block.push_back(it->second);
+    }
+    string encoded = encode_snapshot_block(block);
+    vector<AccountRecord> decoded;
+    CHECK(decode_snapshot_block((const unsigned char*) encoded.data(), encoded.size(), &decoded));
+    CHECK(decoded.size() == block.size());
+    decoded.clear();
+    CHECK(!decode_snapshot_block((const unsigned char*) encoded.data(), encoded.size() / 2, &decoded));
+}
+
+/*
+A savefile and a snapshot of the same bank have no differences, and
+changes between two savefiles are each found once.
+*/
+void test_diff(void) {
+    string savefile = test_file("diff.txt");
+    string snapshot = test_file("diff.snap");
+    string changed = test_file("diff-changed.txt");
+    Bank* bank = sample_bank();
+    CHECK(save_bank(bank, savefile));
+    CHECK(save_bank(bank, snapshot));
+    bank->delete_account(1001);
+    bank->add_account(1004, "Dan", "C", 10);
+    bank->modify_account(1002, 1002, "Bob Jones", "S", 120.5);
+    bank->deposit(1003, 1);
+    CHECK(save_bank(bank, changed));
+    delete bank;
+
+    int status;
+    vector<AccountDiff> diffs = diff_files(savefile, snapshot, &status);
+    CHECK(status == NORMAL_EXIT && diffs.empty());
+    diffs = diff_files(snapshot, changed, &status);
+    CHECK(status == NORMAL_EXIT && diffs.size() == 4);
+    map<int, char> kinds;
+    for (size_t i = 0; i < diffs.size(); i++) {
+        kinds[diffs[i].kind == '+' ? diffs[i].after.accNum : diffs[i].before.accNum] = diffs[i].kind;
+    }
+    CHECK(kinds[1001] == '-' && kinds[1002] == '~' && kinds[1003] == '~' && kinds[1004] == '+');
+    diffs = diff_files(savefile, test_file("missing.txt"), &status);
+    CHECK(status == CANNOT_OPEN_FILE);
+}
+
+/*
+Transaction IDs are loaded back into the generation they were saved
+in, so the older generation is still the first forgotten. A file
+written before generations were saved apart is loaded as one.
+*/
+void test_transaction_ids_round_trip(void) {
+    string fileName = test_file("ids" TXID_FILE_SUFFIX);
+    TransactionIds ids;
+    for (int i = 0; i < TXID_GENERATION_SIZE + 5; i++) {
+        ids.add("old" + to_string(i));
+    }
+    CHECK(ids.save(fileName));
+
+    TransactionIds loaded;
+    loaded.load(fileName);
+    CHECK(loaded.contains("old0"));
+    CHECK(loaded.contains("old" + to_string(TXID_GENERATION_SIZE + 4)));
+    CHECK(!loaded.contains("new0"));
+    for (int i = 0; i < TXID_GENERATION_SIZE - 5; i++) {
+        loaded.add("new" + to_string(i));
+    }
+    CHECK(loaded.contains("old0"));
+    loaded.add("newest");
+    CHECK(!loaded.contains("old0"));
+    CHECK(loaded.contains("old" + to_string(TXID_GENERATION_SIZE + 4)));
+    CHECK(loaded.contains("newest"));
+
+    ofstream unmarked(fileName);
+    unmarked << "first\nsecond\n";
+    unmarked.close();
+    TransactionIds older;
+    older.load(fileName);
+    CHECK(older.contains("first") && older.contains("second"));
+}
+
+/*
+Postings are applied once across runs. A crash after the savefile is
+replaced but before the IDs are keeps the new IDs, and a crash before
+the savefile is replaced discards them, so the IDs always match the
+savefile.
+*/
+void test_postings_crash(void) {
+    string savefile = test_file("posted.txt");
+    string idsFile = savefile + TXID_FILE_SUFFIX;
+    string postings = test_file("postings.csv");
+    function<int(int, char**)> post = run_post;
+    Bank* bank = sample_bank();
+    CHECK(save_bank(bank, savefile));
+    delete bank;
+    ofstream file(postings);
+    file << POSTINGS_HEADER << "\np1,1001,10\np2,1002,-0.5\n";
+    file.close();
+    CHECK(run_mode(post, {"bank", "--post", postings, savefile}) == NORMAL_EXIT);
+    CHECK(run_mode(post, {"bank", "--post", postings, savefile}) == NORMAL_EXIT);
+    bank = load_bank(savefile);
+    CHECK(bank->get_account(1001)->get_balance() == 510);
+    CHECK(bank->get_account(1002)->get_balance() == 120);
+    delete bank;
+
+    file.open(postings);
+    file << "p3,1003,1\n";
+    file.close();
+    filesystem::copy_file(idsFile, idsFile + ".saved");
+    CHECK(run_mode(post, {"bank", "--post", postings, savefile}) == NORMAL_EXIT);
+    filesystem::rename(idsFile, idsFile + TEMP_SUFFIX);
+    filesystem::rename(idsFile + ".saved", idsFile);
+    CHECK(run_mode(post, {"bank", "--post", postings, savefile}) == NORMAL_EXIT);
+    bank = load_bank(savefile);
+    CHECK(bank->get_account(1003)->get_balance() == 76.25);
+    delete bank;
+
+    file.open(postings);
+    file << "p4,1003,1\n";
+    file.close();
+    filesystem::copy_file(savefile, savefile + ".saved");
+    filesystem::copy_file(idsFile, idsFile + ".saved");
+    CHECK(run_mode(post, {"bank", "--post", postings, savefile}) == NORMAL_EXIT);
+    filesystem::rename(idsFile, idsFile + TEMP_SUFFIX);
+    filesystem::rename(idsFile + ".saved", idsFile);
+    filesystem::rename(savefile + ".saved", savefile);
+    ofstream partial(savefile + TEMP_SUFFIX);
+    partial << "Test Bank\n";
+    partial.close();
+    CHECK(run_mode(post, {"bank", "--post", postings, savefile}) == NORMAL_EXIT);
+    bank = load_bank(savefile);
+    CHECK(bank->get_account(1003)->get_balance() == 77.25);
+    delete bank;
+}
+
+/*
+A replica following a journal ends up with the primary's accounts,
+and rebuilds them from the new journal when the primary restarts.
+*/
+void test_change_feed_journal(void) {
+    string journal = test_file("feed.journal");
+    Bank* primary = sample_bank();
+    CdcPublisher* publisher = new CdcPublisher();
+    CHECK(publisher->start(journal, true));
+    primary->attach_cdc(publisher, true);
+    primary->deposit(1001, 5);
+    primary->withdraw(1002, 0.5);
+    primary->modify_account(1003, 1004, "Carol King", "C", 12.25);
+    primary->delete_account(1001);
+    primary->add_account(1005, "Dan Brown", "S", 40);
+    map<int, AccountRecord> records = bank_records(primary);
+    Follower* follower = new Follower(journal);
+    function<bool()> caughtUp = [&]() {
+        bool same = false;
+        follower->read([&](Bank* replica) {
+            map<int, AccountRecord> replicated = bank_records(replica);
+            same = same_records(records, replicated);
+        });
+        return same;
+    };
+    CHECK(wait_until(caughtUp, REPLICA_WAIT_MS));
+
+    primary->attach_cdc(NULL);
+    delete publisher;
+    delete primary;
+    primary = new Bank("Restarted");
+    primary->add_account(3001, "Frank", "C", 7);
+    publisher = new CdcPublisher();
+    CHECK(publisher->start(journal, true));
+    primary->attach_cdc(publisher, true);
+    primary->deposit(3001, 1);
+    records = bank_records(primary);
+    CHECK(wait_until(caughtUp, REPLICA_WAIT_MS));
+    primary->attach_cdc(NULL);
+    delete publisher;
+    delete primary;
+}
+
+int main(void) {
+    testDirectory = (filesystem::temp_directory_path() /
+            ("bank-tests-" + to_string(getpid()))).string();
+    filesystem::create_directories(testDirectory);
+    vector<pair<string, function<void()>>> tests = {
+        {"server journal", test_server_journal},
+        {"history round trip", test_history_round_trip},
+        {"history crash before index", test_history_crash_before_index},
+        {"mutation log round trip", test_mutation_log_round_trip},
+        {"mutation log stale", test_mutation_log_stale},
+        {"snapshot round trip", test_snapshot_round_trip},
+        {"diff", test_diff},
+        {"transaction IDs round trip", test_transaction_ids_round_trip},
+        {"postings crash", test_postings_crash},
+        {"change feed journal", test_change_feed_journal},
+    };
+    for (size_t i = 0; i < tests.size(); i++) {
+        int before = failures;
+        tests[i].second();
+        cout << (failures == before ? "PASS " : "FAIL ") << tests[i].first << endl;
+    }
+    if (failures > 0) {
+        cerr << failures << " checks failed, files kept in " << testDirectory << endl;
+        return 1;
+    }
+    filesystem::remove_all(testDirectory);
+    return 0;
+}